@@ -1,18 +1,95 @@
 /**
- * @file dummy_wifi_module.c
+ * @file dummywifi.c
  * @brief Example Linux kernel module for a Wi-Fi FullMAC driver
  */
 
-#include <linux/module.h>    // Linux module support
-#include <linux/semaphore.h> // Semaphore support
-#include <linux/skbuff.h>    // Network packet manipulation
-#include <linux/workqueue.h> // Workqueue support
-#include <net/cfg80211.h>    // Configuration 802.11 framework
+#include <linux/atomic.h>      // Atomic operations
+#include <linux/bpf.h>         // XDP programs
+#include <linux/bsearch.h>     // Binary search in BSS databases
+#include <linux/cpumask.h>     // CPU masks for transmit queue steering
+#include <linux/debugfs.h>     // Debug file system
+#include <linux/dma-mapping.h> // DMA mask of the parent device
+#include <linux/etherdevice.h> // Ethernet device helpers
+#include <linux/filter.h>      // Running XDP programs
+#include <linux/firmware.h>    // Firmware (BSS database) loading
+#include <linux/hash.h>        // Integer hashing
+#include <linux/hrtimer.h>     // High resolution timers
+#include <linux/ip.h>          // IPv4 header of generated frames
+#include <linux/kref.h>        // Reference counting
+#include <linux/list.h>        // Linked lists
+#include <linux/log2.h>        // Sizing of hash tables
+#include <linux/module.h>      // Linux module support
+#include <linux/mutex.h>       // Mutex support
+#include <linux/netdevice.h>   // Network device and NAPI support
+#include <linux/percpu.h>      // Per-CPU interface statistics
+#include <linux/platform_device.h> // Parent device of the radios
+#include <linux/ptr_ring.h>    // Lockless producer/consumer rings
+#include <linux/random.h>      // Link loss, reordering and jitter
+#include <linux/rtnetlink.h>   // RTNL lock for batched unregistration
+#include <linux/seq_file.h>    // Sequential files for debugfs
+#include <linux/skbuff.h>      // Network packet manipulation
+#include <linux/sort.h>        // Sorting
+#include <linux/spinlock.h>    // Delay wheel lock
+#include <linux/u64_stats_sync.h> // Lock-free 64-bit statistics
+#include <linux/uaccess.h>     // Copying data from user space
+#include <linux/udp.h>         // UDP header of generated frames
+#include <linux/version.h>     // Kernel version check
+#include <linux/workqueue.h>   // Workqueue support
+#include <net/cfg80211.h>      // Configuration 802.11 framework
+#include <net/checksum.h>      // IPv4 header checksum
+#include <net/page_pool/helpers.h> // Recycled receive buffers
+#include <net/xdp.h>           // XDP buffers and frames
+#include <net/xdp_sock_drv.h>  // AF_XDP zero-copy
+#include <trace/events/xdp.h>  // XDP exception tracepoint
+
+// HE capabilities are set with ieee80211_set_sband_iftype_data().
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 7, 0)
+#error "DummyWiFi requires Linux 6.7 or later"
+#endif
+
+#define CREATE_TRACE_POINTS
+#include "dummywifi_trace.h" // Control operation tracepoints
 
 #define WIPHY_NAME "dummy"         // Name of the Wi-Fi device
 #define NDEV_NAME "dummy%d"        // Name template for network devices
 #define SSID_DUMMY "MyAwesomeWiFi" // Default SSID for the Wi-Fi network
-#define SSID_DUMMY_SIZE (sizeof("MyAwesomeWiFi") - 1) // Size of the SSID
+#define NVF_RING_SIZE 256 // Number of frames a receive ring can hold
+#define NVF_MAX_QUEUES 256 // Upper bound for the "queues" module parameter
+#define NVF_MAX_RADIOS 10000 // Upper bound for the "radios" module parameter
+#define NVF_MAX_BSS 100000    // Upper bound for the size of a BSS database
+#define NVF_BSS_LINE_MAX 128  // Longest line of a textual BSS database
+#define NVF_BSS_CTL_MAX (1 << 20) // Largest batch of BSS database commands
+#define NVF_BSS_IES_MAX 256   // Largest IE blob of a single access point
+#define NVF_BEACON_INTERVAL 100 // Beacon interval of the access points (TUs)
+#define NVF_SCHED_SCAN_MAX_MATCH 16 // Match sets of a scheduled scan
+#define NVF_SCHED_SCAN_MAX_PLANS 4  // Scan plans of a scheduled scan
+#define NVF_SCHED_SCAN_MAX_INTERVAL 3600 // Longest scan plan interval (s)
+#define NVF_ROAM_BSSID GENMASK_ULL(47, 0) // BSSID of a roam request
+#define NVF_ROAM_TARGET BIT_ULL(48)    // Roam to the BSSID of the request
+#define NVF_ROAM_NEXT BIT_ULL(49)      // Roam to the strongest other AP
+#define NVF_ROAM_POLICY BIT_ULL(50)    // Roam if the roaming policy says so
+#define NVF_ROAM_REQUESTED BIT_ULL(51) // Timed since the request
+#define NVF_GEN_PERIOD_MIN_NS 10000 // Shortest period of the RX generator
+#define NVF_GEN_MAX_FLOWS 65536     // Upper bound for generated flows
+#define NVF_GEN_SADDR 0xc6120000    // 198.18.0.0, first generated source
+#define NVF_GEN_DADDR 0xc6130001    // 198.19.0.1, generated destination
+#define NVF_GEN_PORT 9              // UDP discard port
+#define NVF_XDP_FLAG 0x1UL // Tags XDP frames on the receive rings
+#define NVF_XDP_TX_BULK 16 // XDP_TX frames sent to the peer at once
+#define NVF_WHEEL_SLOTS 2048       // Slots of the delay wheel, a power of 2
+#define NVF_WHEEL_TICK_NS 100000   // Time covered by a slot, 100 us
+#define NVF_WHEEL_MAX_US 200000    // Upper bound for delay and jitter
+#define NVF_PPM 1000000            // Probabilities are in parts per million
+#define NVF_HIST_BUCKETS 36 // Latency histogram buckets, 1 ns to 2^35 ns
+#define NVF_OP_REPORTING U64_MAX // aborted_ns once the outcome is decided
+
+/* Offloads of the interfaces. Frames never leave the host, so checksums and
+ * segmentation can be deferred until a frame is forwarded to a real device,
+ * which does them in software if it cannot. LLTX is deliberately not set, the
+ * transmit queues are locked by the core. */
+#define NVF_NETDEV_FEATURES                                                    \
+  (NETIF_F_SG | NETIF_F_FRAGLIST | NETIF_F_HW_CSUM | NETIF_F_RXCSUM |          \
+   NETIF_F_HIGHDMA | NETIF_F_GSO_SOFTWARE)
 
 MODULE_LICENSE("GPL v2");
 MODULE_AUTHOR("Ahmad Kamal Nasir <dringakn@gmail.com>");
@@ -21,8 +98,222 @@ MODULE_DESCRIPTION(
     "Dumb example for cfg80211(aka FullMAC) driver."
     "Module creates wireless device with network."
     "The device can work as station(STA mode) only."
-    "The device can perform scan that \"scans\" only dummy network."
-    "Also it performs \"connect\" to the dummy network.");
+    "The device can perform scans, aborted and scheduled ones included, of"
+    " its BSS database of dummy networks."
+    "Also it performs \"connect\", \"disconnect\" and roaming on that"
+    " database, and forwards data frames to a peer or a shared medium.");
+
+/**
+ * @enum dummy_wifi_link_state
+ * @brief Link states of a DummyWiFi radio.
+ *
+ * The link state lives in the low bits of dummy_wifi_context::state and only
+ * changes through compare-and-exchange, so the owner of a transition is
+ * always unambiguous. Scanning is tracked by the independent
+ * DUMMY_WIFI_STATE_SCANNING flag of the same word, which lets a scan run
+ * concurrently with connect and disconnect.
+ */
+enum dummy_wifi_link_state {
+  DUMMY_WIFI_LINK_IDLE,          /**< Not connected. */
+  DUMMY_WIFI_LINK_CONNECTING,    /**< Connect work queued or running. */
+  DUMMY_WIFI_LINK_CONNECTED,     /**< Connected to the dummy ESS. */
+  DUMMY_WIFI_LINK_DISCONNECTING, /**< Disconnect (or connect abort) pending. */
+};
+
+#define DUMMY_WIFI_LINK_MASK 0x0f         // Link state bits of the state word
+#define DUMMY_WIFI_STATE_SCANNING BIT(4) // Scan in progress flag
+
+#define DUMMY_WIFI_BSS_RSN BIT(0) // Access point advertises WPA2-PSK
+
+/**
+ * @struct dummy_wifi_bss
+ * @brief One synthetic access point of the BSS database.
+ *
+ * Kept small and flat (one cache line), so thousands of entries fit in a few
+ * pages and a scan walks them sequentially. The IEs are not stored here but
+ * in the blob of the table, see dummy_wifi_bss_table::ies.
+ *
+ * The generation identifies the content of the entry: two entries with the
+ * same BSSID and generation are identical, so a scan only has to report the
+ * entries whose generation differs from what it reported last time.
+ */
+struct dummy_wifi_bss {
+  struct ieee80211_channel *chan;  /**< Channel of the access point. */
+  u32 ie_offset;                   /**< Offset of the IEs in the table blob. */
+  u32 gen;                         /**< Generation of the content. */
+  s32 signal;                      /**< Signal strength in mBm. */
+  u16 capability;                  /**< Capability field of the beacons. */
+  u16 ie_len;                      /**< Length of the IEs. */
+  u8 bssid[ETH_ALEN];              /**< BSSID of the access point. */
+  u8 ssid_len;                     /**< Length of the SSID. */
+  u8 flags;                        /**< DUMMY_WIFI_BSS_* flags. */
+  u8 ssid[IEEE80211_MAX_SSID_LEN]; /**< SSID, not NUL terminated. */
+};
+
+/**
+ * @struct dummy_wifi_bss_table
+ * @brief Immutable array of synthetic access points.
+ *
+ * A table is never modified once published; updates build a new table and
+ * swap the pointer of the radio. Tables are reference counted, so the default
+ * table is shared by all radios, and freed after an RCU grace period. The
+ * entries are sorted by BSSID, so two tables can be compared in linear time.
+ */
+struct dummy_wifi_bss_table {
+  struct kref kref;            /**< References held by radios and readers. */
+  struct rcu_head rcu;         /**< Deferred freeing. */
+  unsigned int n_bss;          /**< Number of access points. */
+  u8 *ies; /**< IEs of all access points back to back, serialized once when
+              the table is built and reported as-is by every scan. */
+  struct dummy_wifi_bss bss[]; /**< The access points. */
+};
+
+/**
+ * @struct dummy_wifi_rq
+ * @brief Receive queue of a DummyWiFi network device.
+ *
+ * Frames transmitted by the peer device are placed on the ring by the peer's
+ * ndo_start_xmit() and handed to the network stack by the NAPI poll loop of
+ * the receiving device. Each transmit queue of the peer feeds the receive
+ * queue with the same index, so queues are aligned on cache lines to keep
+ * the CPUs driving different queues from sharing them. Buffers of frames
+ * built by the driver itself come from the page pool of the queue, and go
+ * back to it when the stack frees them.
+ */
+struct dummy_wifi_rq {
+  struct napi_struct napi;     /**< NAPI context draining the ring. */
+  struct ptr_ring ring;        /**< Frames waiting to be received. */
+  struct page_pool *page_pool; /**< Receive buffers, recycled by NAPI. */
+  struct xdp_rxq_info xdp_rxq; /**< XDP view of the queue. */
+  struct xsk_buff_pool *xsk_pool; /**< Bound AF_XDP socket, or NULL; only
+                                     changed while NAPI is disabled. */
+  struct xdp_rxq_info xsk_rxq; /**< XDP view of the queue for xsk_pool. */
+  unsigned int tx_sent_pkts;   /**< Frames sent on the transmit queue of the
+                                    same index, under its lock. */
+  unsigned int tx_sent_bytes;  /**< Bytes sent on that transmit queue. */
+  unsigned int tx_done_pkts;   /**< Sent frames completed by NAPI. */
+  unsigned int tx_done_bytes;  /**< Sent bytes completed by NAPI. */
+} ____cacheline_aligned_in_smp;
+
+/**
+ * @struct nvf_wheel_slot
+ * @brief Frames leaving the delay wheel in the same tick, in order.
+ */
+struct nvf_wheel_slot {
+  struct sk_buff *head; /**< First frame, linked through skb->next. */
+  struct sk_buff *tail; /**< Last frame. */
+};
+
+/**
+ * @struct nvf_wheel
+ * @brief Timer wheel holding the frames delayed on the link of a radio.
+ *
+ * Slot N holds the frames due in tick N modulo NVF_WHEEL_SLOTS; delays are
+ * bounded so that a slot never holds frames of two rounds. A single timer,
+ * armed for the earliest non-empty tick, releases all the frames of the due
+ * slots at once.
+ */
+struct nvf_wheel {
+  spinlock_t lock;              /**< Protects the fields below, and
+                                     serializes updates of the link delay
+                                     and jitter. */
+  struct hrtimer timer;         /**< Releases the due slots. */
+  struct dummy_wifi_context *navi; /**< Radio owning the wheel. */
+  u64 next_tick;                /**< First tick not released yet. */
+  u64 armed_tick;               /**< Tick the timer is armed for. */
+  bool armed;                   /**< Whether the timer is armed. */
+  unsigned int queued;          /**< Frames in the wheel. */
+  struct nvf_wheel_slot slot[NVF_WHEEL_SLOTS]; /**< Frames by due tick. */
+};
+
+/**
+ * @struct nvf_air
+ * @brief Shared wireless medium of one channel.
+ *
+ * With the "medium" parameter, radios connected on the channel are attached
+ * to it: they receive the frames the other attached radios transmit, and
+ * contend with them for its airtime.
+ */
+struct nvf_air {
+  const struct ieee80211_channel *chan; /**< Channel of the medium. */
+  struct list_head stations; /**< Attached radios, RCU protected. */
+  atomic64_t busy_until;     /**< End of the airtime used on the channel, ns. */
+  atomic_long_t frames;      /**< Frames transmitted on the channel. */
+};
+
+/**
+ * @enum nvf_op_phase
+ * @brief Phases of a control operation, each with a latency histogram.
+ */
+enum nvf_op_phase {
+  NVF_PHASE_QUEUE,  /**< Work item waiting on the workqueue. */
+  NVF_PHASE_EXEC,   /**< Work item running, report excluded. */
+  NVF_PHASE_REPORT, /**< Reporting the outcome to cfg80211. */
+  NVF_PHASE_TOTAL,  /**< From the request to the report, dwell included. */
+  NVF_PHASE_ABORT,  /**< From an abort request to the report. */
+  NVF_N_PHASES,
+};
+
+/**
+ * @struct nvf_op_stats
+ * @brief Timings of a control operation of a radio.
+ *
+ * Only the work item of the operation updates the histograms; work items
+ * never run concurrently with themselves.
+ */
+struct nvf_op_stats {
+  u64 requested_ns; /**< When the operation in progress was requested. */
+  u64 queued_ns;    /**< When its work item was queued. */
+  u64 aborted_ns;   /**< When it was aborted, 0 if it was not yet,
+                         NVF_OP_REPORTING if it can no longer be. */
+  u64 hist[NVF_N_PHASES][NVF_HIST_BUCKETS]; /**< log2 latency histograms;
+                                                 bucket k counts latencies
+                                                 in [2^k, 2^(k+1)) ns. */
+};
+
+/**
+ * @struct nvf_op_timing
+ * @brief Timings of an operation being executed by its work item.
+ */
+struct nvf_op_timing {
+  u64 requested_ns; /**< When the operation was requested. */
+  u64 start_ns;     /**< When the work item started. */
+  u64 report_ns;    /**< Time spent reporting the outcome to cfg80211. */
+};
+
+/**
+ * @struct nvf_rx_batch
+ * @brief State of one NAPI poll of a receive queue.
+ */
+struct nvf_rx_batch {
+  struct bpf_prog *prog; /**< XDP program of the device, NULL if none. */
+  struct xsk_buff_pool *xsk_pool; /**< Pool receive buffers come from when
+                                     the program runs, NULL for the page
+                                     pool. */
+  u64 packets;           /**< Frames handed to the stack. */
+  u64 bytes;             /**< Bytes handed to the stack. */
+  u64 dropped;           /**< Frames dropped by XDP or for lack of memory. */
+  bool xdp_redirect;     /**< Frames were redirected, a flush is due. */
+  unsigned int n_xdp_tx; /**< Number of frames in xdp_tx. */
+  struct xdp_frame *xdp_tx[NVF_XDP_TX_BULK]; /**< XDP_TX frames to send. */
+};
+
+/**
+ * @struct dummy_wifi_stats
+ * @brief Per-CPU statistics of a DummyWiFi network device.
+ *
+ * Only updated by the CPU owning them, from the transmit path and the NAPI
+ * poll loop, and summed up by nvf_ndo_get_stats64().
+ */
+struct dummy_wifi_stats {
+  u64_stats_t rx_packets;      /**< Frames delivered to the stack. */
+  u64_stats_t rx_bytes;        /**< Bytes delivered to the stack. */
+  u64_stats_t rx_dropped;      /**< Frames dropped by XDP or lack of memory. */
+  u64_stats_t tx_packets;      /**< Frames handed to the peer. */
+  u64_stats_t tx_bytes;        /**< Bytes handed to the peer. */
+  u64_stats_t tx_dropped;      /**< Frames the peer could not take. */
+  struct u64_stats_sync syncp; /**< Consistent reads on 32-bit hosts. */
+};
 
 /**
  * @struct dummy_wifi_context
@@ -32,14 +323,37 @@ MODULE_DESCRIPTION(
  * wireless network manager.
  */
 struct dummy_wifi_context {
+  struct list_head list;   /**< Entry in the list of all radios. */
+  unsigned int idx;        /**< Index of the radio, 0 for the first one. */
   struct wiphy *wiphy;     /**< Pointer to the wireless PHY device. */
   struct net_device *ndev; /**< Pointer to the network device. */
-  struct semaphore sem;    /**< Semaphore for synchronization. */
+
+  atomic_t state; /**< Link state and scanning flag, see
+                     dummy_wifi_link_state. */
+  atomic_long_t
+      state_retries;        /**< Lost compare-and-exchange races on state. */
+  atomic_long_t state_busy; /**< Operations rejected with -EBUSY. */
+  struct nvf_op_stats ops[NVF_N_OPS]; /**< Timings of the control operations,
+                                           see nvf_op_start(). */
 
   struct work_struct
       ws_connect; /**< Work queue item for connection handling. */
-  char connecting_ssid[sizeof(
-      SSID_DUMMY)]; /**< SSID of the currently connecting network. */
+  u8 connecting_ssid[IEEE80211_MAX_SSID_LEN]; /**< SSID of the currently
+                                                 connecting network. */
+  u8 connecting_ssid_len;        /**< Length of the connecting SSID. */
+  u8 connecting_bssid[ETH_ALEN]; /**< Requested BSSID, zero for any. */
+  u8 connected_bssid[ETH_ALEN];  /**< BSSID of the current access point. */
+  struct mutex link_lock; /**< Held by the connect, roam and disconnect work
+                               items while they update the link and report
+                               it, so cfg80211 sees their reports in order. */
+
+  struct work_struct ws_roam; /**< Work queue item for roaming. */
+  atomic64_t roam_request;    /**< Pending roam, 0 if none, see
+                                   NVF_ROAM_POLICY. */
+  s32 roam_threshold;         /**< Signal (dBm) below which the roaming
+                                   policy roams, 0 to disable it. */
+  u32 roam_hysteresis;        /**< Signal gain (dB) needed to roam. */
+  atomic_long_t roams;        /**< Completed roams. */
 
   struct work_struct
       ws_disconnect; /**< Work queue item for disconnection handling. */
@@ -48,19 +362,251 @@ struct dummy_wifi_context {
   struct work_struct ws_scan; /**< Work queue item for wireless scanning. */
   struct cfg80211_scan_request
       *scan_request; /**< Scan request configuration. */
+  struct hrtimer scan_timer; /**< Emulates the dwell time on each channel. */
+  ktime_t scan_dwell;        /**< Dwell time of the scan in progress. */
+  unsigned int scan_channel; /**< Channel being "scanned", index in request. */
+  u32 scan_dwell_us;         /**< Dwell time per channel for next scans. */
+  struct dummy_wifi_bss_table
+      *bss_reported; /**< Table reported by the last scan, owned by it. */
+  unsigned long bss_refresh_at; /**< Time of the next full scan report. */
+  u64 scan_count;            /**< Number of completed scans. */
+  u64 scan_bss_reported;     /**< Access points reported by all scans. */
+  u64 scan_bss_unlinked;     /**< Access points removed by all scans. */
+  u64 scan_inform_ns;        /**< Time spent reporting scan results. */
+  u64 scan_inform_max_ns;    /**< Longest time spent reporting one scan. */
+
+  struct delayed_work
+      ws_sched_scan; /**< Work queue item for scheduled scan iterations. */
+  struct cfg80211_sched_scan_request
+      *sched_scan_request; /**< Running scheduled scan, NULL if none. */
+  unsigned int sched_scan_plan; /**< Scan plan being run, index in request. */
+  unsigned int sched_scan_iter; /**< Iterations run of that scan plan. */
+  u32 *sched_scan_gens;         /**< Generations of the last matches. */
+  unsigned int sched_scan_n_gens; /**< Number of the last matches. */
+  unsigned long sched_scan_refresh_at; /**< Time of the next forced report. */
+  u64 sched_scan_count;   /**< Completed scheduled scan iterations. */
+  u64 sched_scan_results; /**< Iterations that reported results. */
+  u64 sched_scan_ns;      /**< Time spent in scheduled scan iterations. */
+
+  struct dummy_wifi_bss_table
+      __rcu *bss_table; /**< Access points seen by this radio. */
+  struct mutex bss_lock; /**< Serializes updates of bss_table. */
+  u64 bss_ctl_batches;   /**< Command batches applied, under bss_lock. */
+  u64 bss_ctl_cmds;      /**< Commands of the applied batches. */
+  u64 bss_ctl_rejected;  /**< Batches rejected as a whole. */
+  u64 bss_ctl_ns;        /**< Time spent applying batches. */
+  u64 bss_ctl_max_ns;    /**< Longest time spent applying one batch. */
+
+  struct dummy_wifi_context
+      __rcu *peer;       /**< Device receiving our transmitted frames. */
+  struct nvf_air *air;   /**< Shared medium the radio transmits on instead of
+                              to the peer, NULL if none. */
+  struct list_head air_node; /**< Entry in the stations of air. */
+  struct ptr_ring __percpu *air_rings; /**< Frames heard on the medium, one
+                                            ring per sending CPU; allocated
+                                            on first attach. */
+  struct dummy_wifi_rq *rq; /**< Receive queues fed by the peer device. */
+  unsigned int n_queues;    /**< Number of transmit and receive queues. */
+  struct dummy_wifi_stats
+      __percpu *stats; /**< Interface statistics, one copy per CPU. */
+  struct bpf_prog __rcu *xdp_prog; /**< XDP program run on received frames. */
+
+  bool airtime;         /**< Pace transmission by airtime. */
+  u32 tx_rate_kbps;     /**< Forced PHY rate, 0 for the negotiated one. */
+  u32 tx_burst_us;      /**< Airtime that may be queued ahead. */
+  u32 tx_overhead_us;   /**< Airtime overhead of each frame (preamble, ACK,
+                           inter-frame spaces). */
+  u32 link_rate_kbps;   /**< Rate negotiated with the AP, 0 if none. */
+  atomic64_t tx_busy_until; /**< End of the airtime of queued frames, ns. */
+  struct hrtimer tx_timer;  /**< Wakes the transmit queues paused by pacing. */
+  atomic_long_t tx_stops;   /**< Transmit queues paused by pacing. */
+
+  u32 link_loss_ppm;        /**< Probability of losing a transmitted frame. */
+  u32 link_reorder_ppm;     /**< Probability of sending a frame undelayed. */
+  u32 link_delay_us;        /**< Delay of transmitted frames. */
+  u32 link_jitter_us;       /**< Random variation of the delay, +/-. */
+  struct nvf_wheel *wheel;  /**< Delayed frames, allocated on first use. */
+  atomic_long_t link_lost;      /**< Frames lost on the link. */
+  atomic_long_t link_delayed;   /**< Frames delayed on the link. */
+  atomic_long_t link_reordered; /**< Frames sent ahead of delayed ones. */
+
+  struct hrtimer gen_timer; /**< Paces the RX traffic generator. */
+  struct dentry *gen_dir;   /**< debugfs directory of the generator. */
+  struct dentry *pp_stats;  /**< debugfs file of the page pool statistics. */
+  u32 gen_pps;              /**< Generated frames per second, 0 when off. */
+  u32 gen_size;             /**< Length of generated frames in bytes. */
+  u32 gen_flows;            /**< Number of generated flows. */
+  u32 gen_burst;            /**< Frames generated per timer tick. */
+  u64 gen_frac; /**< Credits carried between ticks, in frames * ns. */
+  atomic_t gen_credits; /**< Frames the NAPI poll loop may generate. */
+  u32 gen_flow;         /**< Next flow, only used by the NAPI poll loop. */
+  u64 gen_packets;      /**< Frames generated. */
+  u64 gen_overruns;     /**< Credits lost because the receiver lagged. */
 };
 
 /**
- * @struct dummy_wifi_context
- * @brief Represents the context structure for the DummyWiFi application.
- * @brief g_ctx:Global context variable for the DummyWiFi application.
+ * @brief dummy_wifi_radios: List of all radios created by the module.
+ *
+ * Every radio (wiphy + netdev pair) is represented by a `dummy_wifi_context`
+ * linked in this list in order of increasing index. Radios are only added and
+ * removed at the tail. The list and the radio count are protected by
+ * dummy_wifi_radios_lock.
+ */
+static LIST_HEAD(dummy_wifi_radios);
+static DEFINE_MUTEX(dummy_wifi_radios_lock);
+static unsigned int dummy_wifi_n_radios;
+
+/**
+ * @brief dummy_wifi_wq: Workqueue running the scan/connect/disconnect work
+ * items of all radios.
+ *
+ * It is unbound, so work items of different radios run concurrently on any
+ * CPU instead of queueing behind unrelated work on the system workqueue.
+ */
+static struct workqueue_struct *dummy_wifi_wq;
+
+/**
+ * @brief wq_highpri: Run the driver workqueue with high priority workers.
+ */
+static bool wq_highpri;
+module_param(wq_highpri, bool, 0444);
+MODULE_PARM_DESC(wq_highpri, "Use high priority workers for control "
+                             "operations (default: false)");
+
+/**
+ * @brief wq_max_active: Maximum number of work items of the driver workqueue
+ * executing at the same time.
+ */
+static int wq_max_active;
+module_param(wq_max_active, int, 0444);
+MODULE_PARM_DESC(wq_max_active, "Maximum number of concurrently executing "
+                                "control operations, 0 for the workqueue "
+                                "default (default: 0)");
+
+/**
+ * @brief queues: Number of transmit and receive queues of new interfaces.
+ *
+ * 0 gives one queue per online CPU, so that senders on different CPUs do not
+ * contend on a single qdisc lock.
+ */
+static unsigned int queues;
+module_param(queues, uint, 0444);
+MODULE_PARM_DESC(queues, "Number of TX/RX queues per interface, 0 for one "
+                         "per online CPU (default: 0, max: "
+                         __stringify(NVF_MAX_QUEUES) ")");
+
+/**
+ * @brief scan_dwell_us: Default time spent on each channel during a scan.
+ *
+ * Applied to radios when they are created; the per-radio value can be changed
+ * at runtime in /sys/kernel/debug/ieee80211/<wiphy>/scan_dwell_us.
+ */
+static unsigned int scan_dwell_us = 100000;
+module_param(scan_dwell_us, uint, 0644);
+MODULE_PARM_DESC(scan_dwell_us, "Dwell time per scanned channel in "
+                                "microseconds, 0 to complete scans at once "
+                                "(default: 100000)");
+
+/**
+ * @brief bss_count: Number of access points of the generated BSS database.
+ *
+ * The first access point is the well-known SSID_DUMMY network, the others get
+ * distinct BSSIDs, SSIDs, channels and signal strengths.
+ */
+static unsigned int bss_count = 1;
+module_param(bss_count, uint, 0444);
+MODULE_PARM_DESC(bss_count, "Number of generated access points (default: 1, "
+                            "max: " __stringify(NVF_MAX_BSS) ")");
+
+/**
+ * @brief bss_firmware: Firmware file holding the default BSS database.
+ *
+ * When set, the database is loaded from this file instead of being generated.
+ * See dummy_wifi_bss_parse_line() for the format.
+ */
+static char *bss_firmware;
+module_param(bss_firmware, charp, 0444);
+MODULE_PARM_DESC(bss_firmware, "Load the BSS database from this firmware "
+                               "file instead of generating it");
+
+/**
+ * @brief airtime: Pace the transmission of new radios by airtime.
+ *
+ * Per radio, pacing is tuned in /sys/kernel/debug/ieee80211/<wiphy>/airtime.
+ */
+static bool airtime;
+module_param(airtime, bool, 0444);
+MODULE_PARM_DESC(airtime, "Pace transmission at the negotiated PHY rate "
+                          "(default: false)");
+
+/**
+ * @brief medium: Connect the radios through a shared medium per channel.
+ *
+ * Applies to subsequent connections.
+ */
+static bool medium;
+module_param(medium, bool, 0644);
+MODULE_PARM_DESC(medium, "Connected radios exchange frames with the other "
+                         "radios connected on their channel instead of their "
+                         "peer (default: false)");
+
+/**
+ * @brief roam_threshold: Default signal below which a radio roams.
+ *
+ * Applied to radios when they are created; the per-radio value can be changed
+ * at runtime in /sys/kernel/debug/ieee80211/<wiphy>/roam/threshold_dbm.
+ */
+static int roam_threshold;
+module_param(roam_threshold, int, 0644);
+MODULE_PARM_DESC(roam_threshold, "Signal in dBm below which a connected "
+                                 "radio roams to a stronger access point of "
+                                 "its ESS, 0 to disable (default: 0)");
+
+/**
+ * @brief roam_hysteresis: Default signal gain required to roam.
+ */
+static unsigned int roam_hysteresis = 5;
+module_param(roam_hysteresis, uint, 0644);
+MODULE_PARM_DESC(roam_hysteresis, "Signal gain in dB a radio needs to roam "
+                                  "(default: 5)");
+
+/**
+ * @brief scan_full_refresh_ms: Interval between full scan reports.
+ *
+ * Between full reports, a scan only reports the access points that changed
+ * since the previous scan of the radio. cfg80211 expires BSSes not seen for
+ * 30 s, so the interval must stay below that. 0 makes every report full.
+ */
+static unsigned int scan_full_refresh_ms = 15000;
+module_param(scan_full_refresh_ms, uint, 0644);
+MODULE_PARM_DESC(scan_full_refresh_ms, "Interval between full scan reports in "
+                                       "milliseconds, 0 to always report all "
+                                       "access points (default: 15000)");
+
+/**
+ * @brief dummy_wifi_bss_gen: Last generation given to a BSS entry.
+ */
+static atomic_t dummy_wifi_bss_gen = ATOMIC_INIT(0);
+
+/**
+ * @brief dummy_wifi_default_bss: BSS database given to new radios.
+ */
+static struct dummy_wifi_bss_table *dummy_wifi_default_bss;
+
+/**
+ * @brief Set once the module is initialized; before that, writes to the
+ * "radios" parameter only record the requested count.
+ */
+static bool dummy_wifi_ready;
+
+/**
+ * @brief dummy_wifi_pdev: Parent device of all wiphys and network devices.
  *
- * This variable holds a pointer to an instance of the `dummy_wifi_context`
- * structure, which is used to maintain the application's state and
- * configuration. It is initialized as NULL and should be allocated memory and
- * initialized before use.
+ * AF_XDP zero-copy pools must be DMA mapped by the driver, so the radios
+ * need a device that can map memory: a platform device with a 64-bit DMA
+ * mask, for which mapping is the identity and never bounces.
  */
-static struct dummy_wifi_context *g_ctx = NULL;
+static struct platform_device *dummy_wifi_pdev;
 
 /**
  * @struct dummy_wifi_wiphy_priv_context
@@ -129,498 +675,5330 @@ ndev_get_navi_context(struct net_device *ndev) {
 }
 
 /**
- * @brief Inform the kernel about a dummy BSS (Basic Service Set).
+ * @brief Define a supported channel.
  *
- * This function informs the Linux kernel about the presence of a dummy BSS
- * (Basic Service Set) for a wireless network interface. It provides information
- * about the BSS, such as its channel, signal strength, BSSID, and other
- * details.
+ * @param _band Band of the channel.
+ * @param _freq Center frequency of the channel in MHz.
+ */
+#define NVF_CHAN(_band, _freq)                                                 \
+  { .band = (_band), .center_freq = (_freq), .hw_value = (_freq) }
+
+/**
+ * @brief Supported 2.4 GHz channels, 1 to 13.
  *
- * @param navi Pointer to the navigation context structure.
+ * Channel 14 is left out, it only allows 802.11b.
  */
-static void inform_dummy_bss(struct dummy_wifi_context *navi) {
-  struct cfg80211_bss *bss = NULL;
+static struct ieee80211_channel nvf_supported_channels_2ghz[] = {
+    NVF_CHAN(NL80211_BAND_2GHZ, 2412), NVF_CHAN(NL80211_BAND_2GHZ, 2417),
+    NVF_CHAN(NL80211_BAND_2GHZ, 2422), NVF_CHAN(NL80211_BAND_2GHZ, 2427),
+    NVF_CHAN(NL80211_BAND_2GHZ, 2432), NVF_CHAN(NL80211_BAND_2GHZ, 2437),
+    NVF_CHAN(NL80211_BAND_2GHZ, 2442), NVF_CHAN(NL80211_BAND_2GHZ, 2447),
+    NVF_CHAN(NL80211_BAND_2GHZ, 2452), NVF_CHAN(NL80211_BAND_2GHZ, 2457),
+    NVF_CHAN(NL80211_BAND_2GHZ, 2462), NVF_CHAN(NL80211_BAND_2GHZ, 2467),
+    NVF_CHAN(NL80211_BAND_2GHZ, 2472),
+};
 
-  // Define the information about the BSS.
-  struct cfg80211_inform_bss data = {
-      .chan = &navi->wiphy->bands[NL80211_BAND_2GHZ]
-                   ->channels[0], /* the only channel for this demo */
-      .scan_width = NL80211_BSS_CHAN_WIDTH_20,
-      /* signal "type" not specified in this DEMO so it's basically unused,
-         it can be some kind of percentage from 0 to 100 or mBm value */
-      /* signal "type" may be specified before wiphy registration by setting
-         wiphy->signal_type */
-      .signal = 1337,
-  };
+/**
+ * @brief Supported 5 GHz channels: 36 to 64 (U-NII-1/2A), 100 to 144
+ * (U-NII-2C) and 149 to 177 (U-NII-3/4).
+ */
+static struct ieee80211_channel nvf_supported_channels_5ghz[] = {
+    NVF_CHAN(NL80211_BAND_5GHZ, 5180), NVF_CHAN(NL80211_BAND_5GHZ, 5200),
+    NVF_CHAN(NL80211_BAND_5GHZ, 5220), NVF_CHAN(NL80211_BAND_5GHZ, 5240),
+    NVF_CHAN(NL80211_BAND_5GHZ, 5260), NVF_CHAN(NL80211_BAND_5GHZ, 5280),
+    NVF_CHAN(NL80211_BAND_5GHZ, 5300), NVF_CHAN(NL80211_BAND_5GHZ, 5320),
+    NVF_CHAN(NL80211_BAND_5GHZ, 5500), NVF_CHAN(NL80211_BAND_5GHZ, 5520),
+    NVF_CHAN(NL80211_BAND_5GHZ, 5540), NVF_CHAN(NL80211_BAND_5GHZ, 5560),
+    NVF_CHAN(NL80211_BAND_5GHZ, 5580), NVF_CHAN(NL80211_BAND_5GHZ, 5600),
+    NVF_CHAN(NL80211_BAND_5GHZ, 5620), NVF_CHAN(NL80211_BAND_5GHZ, 5640),
+    NVF_CHAN(NL80211_BAND_5GHZ, 5660), NVF_CHAN(NL80211_BAND_5GHZ, 5680),
+    NVF_CHAN(NL80211_BAND_5GHZ, 5700), NVF_CHAN(NL80211_BAND_5GHZ, 5720),
+    NVF_CHAN(NL80211_BAND_5GHZ, 5745), NVF_CHAN(NL80211_BAND_5GHZ, 5765),
+    NVF_CHAN(NL80211_BAND_5GHZ, 5785), NVF_CHAN(NL80211_BAND_5GHZ, 5805),
+    NVF_CHAN(NL80211_BAND_5GHZ, 5825), NVF_CHAN(NL80211_BAND_5GHZ, 5845),
+    NVF_CHAN(NL80211_BAND_5GHZ, 5865), NVF_CHAN(NL80211_BAND_5GHZ, 5885),
+};
 
-  // Define the BSSID (Basic Service Set Identifier).
-  char bssid[6] = {0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+/**
+ * @brief Supported 6 GHz channels, the 20 MHz channels 1 to 233.
+ */
+static struct ieee80211_channel nvf_supported_channels_6ghz[] = {
+    NVF_CHAN(NL80211_BAND_6GHZ, 5955), NVF_CHAN(NL80211_BAND_6GHZ, 5975),
+    NVF_CHAN(NL80211_BAND_6GHZ, 5995), NVF_CHAN(NL80211_BAND_6GHZ, 6015),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6035), NVF_CHAN(NL80211_BAND_6GHZ, 6055),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6075), NVF_CHAN(NL80211_BAND_6GHZ, 6095),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6115), NVF_CHAN(NL80211_BAND_6GHZ, 6135),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6155), NVF_CHAN(NL80211_BAND_6GHZ, 6175),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6195), NVF_CHAN(NL80211_BAND_6GHZ, 6215),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6235), NVF_CHAN(NL80211_BAND_6GHZ, 6255),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6275), NVF_CHAN(NL80211_BAND_6GHZ, 6295),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6315), NVF_CHAN(NL80211_BAND_6GHZ, 6335),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6355), NVF_CHAN(NL80211_BAND_6GHZ, 6375),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6395), NVF_CHAN(NL80211_BAND_6GHZ, 6415),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6435), NVF_CHAN(NL80211_BAND_6GHZ, 6455),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6475), NVF_CHAN(NL80211_BAND_6GHZ, 6495),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6515), NVF_CHAN(NL80211_BAND_6GHZ, 6535),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6555), NVF_CHAN(NL80211_BAND_6GHZ, 6575),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6595), NVF_CHAN(NL80211_BAND_6GHZ, 6615),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6635), NVF_CHAN(NL80211_BAND_6GHZ, 6655),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6675), NVF_CHAN(NL80211_BAND_6GHZ, 6695),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6715), NVF_CHAN(NL80211_BAND_6GHZ, 6735),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6755), NVF_CHAN(NL80211_BAND_6GHZ, 6775),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6795), NVF_CHAN(NL80211_BAND_6GHZ, 6815),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6835), NVF_CHAN(NL80211_BAND_6GHZ, 6855),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6875), NVF_CHAN(NL80211_BAND_6GHZ, 6895),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6915), NVF_CHAN(NL80211_BAND_6GHZ, 6935),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6955), NVF_CHAN(NL80211_BAND_6GHZ, 6975),
+    NVF_CHAN(NL80211_BAND_6GHZ, 6995), NVF_CHAN(NL80211_BAND_6GHZ, 7015),
+    NVF_CHAN(NL80211_BAND_6GHZ, 7035), NVF_CHAN(NL80211_BAND_6GHZ, 7055),
+    NVF_CHAN(NL80211_BAND_6GHZ, 7075), NVF_CHAN(NL80211_BAND_6GHZ, 7095),
+    NVF_CHAN(NL80211_BAND_6GHZ, 7115),
+};
 
-  /* ie - array of tags that are usually retrieved from the beacon frame or
-     probe response. */
-  char ie[SSID_DUMMY_SIZE + 2] = {WLAN_EID_SSID, SSID_DUMMY_SIZE};
-  // Copy the SSID (Service Set Identifier) into the IE (Information Element)
-  // array.
-  memcpy(ie + 2, SSID_DUMMY, SSID_DUMMY_SIZE);
+/**
+ * @brief An array of supported IEEE 802.11 rates for 2.4GHz frequency band.
+ *
+ * The 802.11b (DSSS/CCK) rates come first, then the 802.11g (OFDM) rates;
+ * the 5 and 6 GHz bands only use the OFDM ones. Bitrates are in units of
+ * 100 kbps.
+ */
+static struct ieee80211_rate nvf_supported_rates_2ghz[] = {
+    {.bitrate = 10, .hw_value = 0x1},  {.bitrate = 20, .hw_value = 0x2},
+    {.bitrate = 55, .hw_value = 0x4},  {.bitrate = 110, .hw_value = 0x8},
+    {.bitrate = 60, .hw_value = 0x10}, {.bitrate = 90, .hw_value = 0x20},
+    {.bitrate = 120, .hw_value = 0x40}, {.bitrate = 180, .hw_value = 0x80},
+    {.bitrate = 240, .hw_value = 0x100}, {.bitrate = 360, .hw_value = 0x200},
+    {.bitrate = 480, .hw_value = 0x400}, {.bitrate = 540, .hw_value = 0x800},
+};
 
-  /* It is also possible to use cfg80211_inform_bss() instead of
-     cfg80211_inform_bss_data() */
-  // Inform the kernel about the BSS with the provided data.
-  bss = cfg80211_inform_bss_data(navi->wiphy, &data, CFG80211_BSS_FTYPE_UNKNOWN,
-                                 bssid, 0, WLAN_CAPABILITY_ESS, 100, ie,
-                                 sizeof(ie), GFP_KERNEL);
+#define NVF_N_DSSS_RATES 4 // 802.11b rates at the start of the rate table
 
-  /* Free the cfg80211_bss structure. The refcounter of the structure
-     should be decremented if it's not used. */
-  cfg80211_put_bss(navi->wiphy, bss);
-}
+/* Every band supports two spatial streams: MCS 0-15 for HT, MCS 0-9 per
+ * stream for VHT and MCS 0-11 per stream for HE. */
+#define NVF_NSS 2
+#define NVF_HT_MCS_CAP                                                         \
+  {                                                                            \
+    .rx_mask = {0xff, 0xff}, .rx_highest = cpu_to_le16(300),                   \
+    .tx_params = IEEE80211_HT_MCS_TX_DEFINED,                                  \
+  }
+#define NVF_VHT_MCS_MAP 0xfffa // MCS 0-9 on streams 1 and 2, none above
+#define NVF_HE_MCS_MAP 0xfffa  // MCS 0-11 on streams 1 and 2, none above
 
 /**
- * @brief This function is a routine for performing a Wi-Fi scan in the dummy
- * context.
- * "Scan" routine for DEMO. It just inform the kernel about "dummy" BSS and
- * "finishs" scan. When scan is done it should call cfg80211_scan_done() to
- * inform the kernel that scan is finished. This routine called through
- * workqueue, when the kernel asks about scan through cfg80211_ops.
+ * @brief Define the HE capabilities of a station on a band.
  *
- * @param w A pointer to a work_struct representing the work to be done.
+ * @param _width Channel width set of the band (HE PHY capabilities, byte 0).
  */
-static void dummy_wifi_scan_routine(struct work_struct *w) {
-  // Retrieve the dummy context from the work_struct using container_of
-  struct dummy_wifi_context *navi =
-      container_of(w, struct dummy_wifi_context, ws_scan);
+#define NVF_HE_CAP(_width)                                                     \
+  {                                                                            \
+    .has_he = true,                                                            \
+    .he_cap_elem =                                                             \
+        {                                                                      \
+            .mac_cap_info[0] = IEEE80211_HE_MAC_CAP0_HTC_HE,                   \
+            .phy_cap_info[0] = (_width),                                       \
+            .phy_cap_info[1] = IEEE80211_HE_PHY_CAP1_LDPC_CODING_IN_PAYLOAD,   \
+        },                                                                     \
+    .he_mcs_nss_supp =                                                         \
+        {                                                                      \
+            .rx_mcs_80 = cpu_to_le16(NVF_HE_MCS_MAP),                          \
+            .tx_mcs_80 = cpu_to_le16(NVF_HE_MCS_MAP),                          \
+            .rx_mcs_160 = cpu_to_le16(NVF_HE_MCS_MAP),                         \
+            .tx_mcs_160 = cpu_to_le16(NVF_HE_MCS_MAP),                         \
+            .rx_mcs_80p80 = cpu_to_le16(0xffff),                               \
+            .tx_mcs_80p80 = cpu_to_le16(0xffff),                               \
+        },                                                                     \
+  }
 
-  // Create a structure to hold scan information, initialize 'aborted' to false
-  struct cfg80211_scan_info info = {
-      /* if scan was aborted by user (calling cfg80211_ops->abort_scan) or by
-         any driver/hardware issue - field should be set to "true" */
-      .aborted = false,
-  };
+// 40, 80 and 160 MHz channels, on the 5 and 6 GHz bands alike.
+#define NVF_HE_WIDTH_5GHZ                                                      \
+  (IEEE80211_HE_PHY_CAP0_CHANNEL_WIDTH_SET_40MHZ_80MHZ_IN_5G |                 \
+   IEEE80211_HE_PHY_CAP0_CHANNEL_WIDTH_SET_160MHZ_IN_5G)
 
-  /* Pretend some work, also, you can't call cfg80211_scan_done right away after
-   * cfg80211_ops->scan(). It's unclear why, but the netlink client may not
-   * receive the "scan done" message. It could be due to potential concurrency
-   * between "scan_routine" and cfg80211_ops->scan(), causing
-   * cfg80211_scan_done() to be called before cfg80211_ops->scan() returns. */
-  msleep(100);
+/**
+ * @brief HE (802.11ax) capabilities of the stations on the 2.4 GHz band.
+ */
+static const struct ieee80211_sband_iftype_data nvf_he_iftype_2ghz[] = {{
+    .types_mask = BIT(NL80211_IFTYPE_STATION),
+    .he_cap = NVF_HE_CAP(IEEE80211_HE_PHY_CAP0_CHANNEL_WIDTH_SET_40MHZ_IN_2G),
+}};
 
-  /* Inform with dummy BSS */
-  inform_dummy_bss(navi);
+/**
+ * @brief HE (802.11ax) capabilities of the stations on the 5 GHz band.
+ */
+static const struct ieee80211_sband_iftype_data nvf_he_iftype_5ghz[] = {{
+    .types_mask = BIT(NL80211_IFTYPE_STATION),
+    .he_cap = NVF_HE_CAP(NVF_HE_WIDTH_5GHZ),
+}};
 
-  // Check if the semaphore can be acquired, return if interrupted
-  if (down_interruptible(&navi->sem)) {
-    return;
-  }
+/**
+ * @brief HE (802.11ax) capabilities of the stations on the 6 GHz band, which
+ * has no HT or VHT.
+ */
+static const struct ieee80211_sband_iftype_data nvf_he_iftype_6ghz[] = {{
+    .types_mask = BIT(NL80211_IFTYPE_STATION),
+    .he_cap = NVF_HE_CAP(NVF_HE_WIDTH_5GHZ),
+    .he_6ghz_capa.capa = cpu_to_le16(IEEE80211_HE_6GHZ_CAP_MAX_AMPDU_LEN_EXP |
+                                     IEEE80211_HE_6GHZ_CAP_MAX_MPDU_LEN),
+}};
 
-  /* Finish the scan by calling cfg80211_scan_done() with the scan request and
-   * info. It marks the scan as complete and provides information about the scan
-   * status. */
-  cfg80211_scan_done(navi->scan_request, &info);
+/**
+ * @brief The 2.4 GHz band: 802.11b/g rates, HT (802.11n) on 20 and 40 MHz
+ * channels, and HE once nvf_bands_init() has run.
+ */
+static struct ieee80211_supported_band nf_band_2ghz = {
+    .band = NL80211_BAND_2GHZ,
+    .channels = nvf_supported_channels_2ghz,
+    .n_channels = ARRAY_SIZE(nvf_supported_channels_2ghz),
+    .bitrates = nvf_supported_rates_2ghz,
+    .n_bitrates = ARRAY_SIZE(nvf_supported_rates_2ghz),
+    .ht_cap =
+        {
+            .ht_supported = true,
+            .cap = IEEE80211_HT_CAP_SUP_WIDTH_20_40 | IEEE80211_HT_CAP_SGI_20 |
+                   IEEE80211_HT_CAP_SGI_40 | IEEE80211_HT_CAP_DSSSCCK40,
+            .ampdu_factor = IEEE80211_HT_MAX_AMPDU_64K,
+            .ampdu_density = IEEE80211_HT_MPDU_DENSITY_NONE,
+            .mcs = NVF_HT_MCS_CAP,
+        },
+};
 
-  // Reset the scan_request pointer to NULL
-  navi->scan_request = NULL;
+/**
+ * @brief The 5 GHz band: 802.11a rates, HT, VHT (802.11ac) up to 160 MHz
+ * channels, and HE once nvf_bands_init() has run.
+ */
+static struct ieee80211_supported_band nf_band_5ghz = {
+    .band = NL80211_BAND_5GHZ,
+    .channels = nvf_supported_channels_5ghz,
+    .n_channels = ARRAY_SIZE(nvf_supported_channels_5ghz),
+    .bitrates = nvf_supported_rates_2ghz + NVF_N_DSSS_RATES,
+    .n_bitrates = ARRAY_SIZE(nvf_supported_rates_2ghz) - NVF_N_DSSS_RATES,
+    .ht_cap =
+        {
+            .ht_supported = true,
+            .cap = IEEE80211_HT_CAP_SUP_WIDTH_20_40 | IEEE80211_HT_CAP_SGI_20 |
+                   IEEE80211_HT_CAP_SGI_40,
+            .ampdu_factor = IEEE80211_HT_MAX_AMPDU_64K,
+            .ampdu_density = IEEE80211_HT_MPDU_DENSITY_NONE,
+            .mcs = NVF_HT_MCS_CAP,
+        },
+    .vht_cap =
+        {
+            .vht_supported = true,
+            .cap = IEEE80211_VHT_CAP_MAX_MPDU_LENGTH_11454 |
+                   IEEE80211_VHT_CAP_SUPP_CHAN_WIDTH_160MHZ |
+                   IEEE80211_VHT_CAP_RXLDPC | IEEE80211_VHT_CAP_SHORT_GI_80 |
+                   IEEE80211_VHT_CAP_SHORT_GI_160 |
+                   IEEE80211_VHT_CAP_MAX_A_MPDU_LENGTH_EXPONENT_MASK,
+            .vht_mcs =
+                {
+                    .rx_mcs_map = cpu_to_le16(NVF_VHT_MCS_MAP),
+                    .tx_mcs_map = cpu_to_le16(NVF_VHT_MCS_MAP),
+                },
+        },
+};
+
+/**
+ * @brief The 6 GHz band: OFDM rates and HE only, once nvf_bands_init() has
+ * run.
+ */
+static struct ieee80211_supported_band nf_band_6ghz = {
+    .band = NL80211_BAND_6GHZ,
+    .channels = nvf_supported_channels_6ghz,
+    .n_channels = ARRAY_SIZE(nvf_supported_channels_6ghz),
+    .bitrates = nvf_supported_rates_2ghz + NVF_N_DSSS_RATES,
+    .n_bitrates = ARRAY_SIZE(nvf_supported_rates_2ghz) - NVF_N_DSSS_RATES,
+};
+
+/**
+ * @brief Bands supported by every DummyWiFi radio, indexed by nl80211 band.
+ */
+static struct ieee80211_supported_band *nvf_bands[NUM_NL80211_BANDS] = {
+    [NL80211_BAND_2GHZ] = &nf_band_2ghz,
+    [NL80211_BAND_5GHZ] = &nf_band_5ghz,
+    [NL80211_BAND_6GHZ] = &nf_band_6ghz,
+};
 
-  // Release the semaphore to allow other processes to access the dummy
-  // context
-  up(&navi->sem);
+/**
+ * @brief Attach the HE capabilities to the supported bands.
+ *
+ * The iftype data of a band can only be set through its accessor.
+ */
+static void nvf_bands_init(void) {
+  ieee80211_set_sband_iftype_data(&nf_band_2ghz, nvf_he_iftype_2ghz);
+  ieee80211_set_sband_iftype_data(&nf_band_5ghz, nvf_he_iftype_5ghz);
+  ieee80211_set_sband_iftype_data(&nf_band_6ghz, nvf_he_iftype_6ghz);
 }
 
 /**
- * @brief Connect routine for the DummyWiFi device.
- * This function is responsible for handling the connection routine of the
- * DummyWiFi device. It checks if the connecting SSID is a dummy SSID and takes
- * appropriate actions.
+ * @brief Shared media, one per supported channel, see nvf_channel_air().
+ */
+static struct nvf_air nvf_airs[ARRAY_SIZE(nvf_supported_channels_2ghz) +
+                               ARRAY_SIZE(nvf_supported_channels_5ghz) +
+                               ARRAY_SIZE(nvf_supported_channels_6ghz)];
+
+/**
+ * @brief Serializes the attachment of radios to the shared media.
+ */
+static DEFINE_SPINLOCK(nvf_air_lock);
+
+/**
+ * @brief Get the shared medium of a supported channel.
  *
- * It just checks SSID of the ESS to connect and informs the kernel that connect
- * is finished. It should call cfg80211_connect_bss() when connect is finished
- * or cfg80211_connect_timeout() when connect is failed. This "demo" can connect
- * only to ESS with SSID equal to SSID_DUMMY value. This routine called through
- * workqueue, when the kernel asks about connect through cfg80211_ops.
+ * Media are numbered like the channels, band after band.
  *
+ * @param chan Channel of one of the supported bands.
  *
- * @param w A pointer to the work_struct associated with the connection routine.
+ * @return The medium, or NULL if @p chan is not a supported channel.
  */
-static void dummy_wifi_connect_routine(struct work_struct *w) {
-  // Retrieve the DummyWiFi context from the work_struct.
-  struct dummy_wifi_context *navi =
-      container_of(w, struct dummy_wifi_context, ws_connect);
+static struct nvf_air *nvf_channel_air(const struct ieee80211_channel *chan) {
+  const struct ieee80211_supported_band *sband;
+  enum nl80211_band band;
+  unsigned int base = 0;
 
-  // Attempt to acquire a semaphore lock. If interrupted, return.
-  if (down_interruptible(&navi->sem)) {
-    return;
+  for (band = 0; band < NUM_NL80211_BANDS; band++) {
+    sband = nvf_bands[band];
+    if (sband == NULL) {
+      continue;
+    }
+    if (chan >= sband->channels && chan < sband->channels + sband->n_channels) {
+      return &nvf_airs[base + (chan - sband->channels)];
+    }
+    base += sband->n_channels;
   }
 
-  // Check if the connecting SSID is not a dummy SSID.
-  if (memcmp(navi->connecting_ssid, SSID_DUMMY, sizeof(SSID_DUMMY)) != 0) {
-    // The SSID is not a dummy, trigger a connection timeout.
-    cfg80211_connect_timeout(navi->ndev, NULL, NULL, 0, GFP_KERNEL,
-                             NL80211_TIMEOUT_SCAN);
-  } else {
-    // The SSID is a dummy SSID.
+  return NULL;
+}
 
-    // Send dummy BSS information to the kernel.
-    inform_dummy_bss(navi);
+/**
+ * @brief Initialize the shared media of all the supported channels.
+ */
+static void nvf_air_init(void) {
+  const struct ieee80211_supported_band *sband;
+  enum nl80211_band band;
+  unsigned int n = 0;
+  int i;
 
-    // Notify the kernel of a successful connection to a known ESS.
-    // It's also possible to use cfg80211_connect_result() or
-    // cfg80211_connect_done().
-    cfg80211_connect_bss(navi->ndev, NULL, NULL, NULL, 0, NULL, 0,
-                         WLAN_STATUS_SUCCESS, GFP_KERNEL,
-                         NL80211_TIMEOUT_UNSPECIFIED);
+  for (band = 0; band < NUM_NL80211_BANDS; band++) {
+    sband = nvf_bands[band];
+    if (sband == NULL) {
+      continue;
+    }
+    for (i = 0; i < sband->n_channels; i++, n++) {
+      nvf_airs[n].chan = &sband->channels[i];
+      INIT_LIST_HEAD(&nvf_airs[n].stations);
+    }
   }
-
-  // Clear the connecting SSID to indicate that the connection is complete.
-  navi->connecting_ssid[0] = 0;
-
-  // Release the semaphore lock.
-  up(&navi->sem);
 }
 
 /**
- * @brief Disconnect routine for the DummyWiFi driver.
+ * @brief Allocate the per-CPU receive rings of the shared medium of a radio.
  *
- * This function is responsible for handling disconnection events in the
- * DummyWiFi driver. It gets invoked as part of a work queue.
- * This routine called through workqueue, when the kernel asks about
- * disconnect through cfg80211_ops.
+ * Stations of a medium deliver to each other through these rings, so only
+ * radios that ever join a medium pay for them. They are kept until the radio
+ * is freed, see dummy_wifi_air_rings_free().
  *
- * @param w Pointer to the work structure associated with the disconnection.
+ * @param navi Pointer to the DummyWiFi context.
+ *
+ * @return 0 on success, -ENOMEM on failure.
  */
-static void dummy_wifi_disconnect_routine(struct work_struct *w) {
+static int dummy_wifi_air_rings_alloc(struct dummy_wifi_context *navi) {
+  struct ptr_ring __percpu *rings;
+  int cpu;
 
-  // Extract the DummyWiFi context structure from the work structure.
-  struct dummy_wifi_context *navi =
-      container_of(w, struct dummy_wifi_context, ws_disconnect);
+  if (navi->air_rings != NULL) {
+    return 0;
+  }
 
-  // Attempt to acquire a semaphore, which is a synchronization primitive.
-  // If interrupted by a signal (e.g., Ctrl+C), return without further action.
-  if (down_interruptible(&navi->sem)) {
-    return;
+  rings = alloc_percpu(struct ptr_ring);
+  if (rings == NULL) {
+    return -ENOMEM;
   }
 
-  // This function informs the wireless stack that the device has disconnected.
-  // Notify the wireless networking stack about the disconnection event.
-  // Parameters:
-  // - navi->ndev: The DummyWiFi network device.
+  for_each_possible_cpu(cpu) {
+    if (ptr_ring_init(per_cpu_ptr(rings, cpu), NVF_RING_SIZE, GFP_KERNEL)) {
+      goto l_error;
+    }
+  }
+
+  // Pairs with the acquire in nvf_napi_poll(): rings are seen initialized.
+  smp_store_release(&navi->air_rings, rings);
+  return 0;
+
+l_error:
+  // Rings not initialized yet are zeroed, cleaning them up is a no-op.
+  for_each_possible_cpu(cpu) {
+    ptr_ring_cleanup(per_cpu_ptr(rings, cpu), NULL);
+  }
+  free_percpu(rings);
+  return -ENOMEM;
+}
+
+/**
+ * @brief Attach a radio to the shared medium of a channel.
+ *
+ * The radio must not be attached to any medium, see dummy_wifi_air_detach().
+ * If its medium rings cannot be allocated the radio stays off the medium and
+ * keeps transmitting to its peer.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param chan Channel the radio is connected on.
+ */
+static void dummy_wifi_air_attach(struct dummy_wifi_context *navi,
+                                  const struct ieee80211_channel *chan) {
+  struct nvf_air *air = nvf_channel_air(chan);
+
+  if (air == NULL) {
+    return;
+  }
+
+  if (dummy_wifi_air_rings_alloc(navi)) {
+    return;
+  }
+
+  spin_lock_bh(&nvf_air_lock);
+  list_add_tail_rcu(&navi->air_node, &air->stations);
+  WRITE_ONCE(navi->air, air);
+  spin_unlock_bh(&nvf_air_lock);
+}
+
+/**
+ * @brief Detach a radio from its shared medium, if any.
+ *
+ * Other radios may still be delivering to it, or walking past it, until an
+ * RCU grace period has elapsed; the caller must wait for one before the
+ * radio is attached again or freed.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ */
+static void dummy_wifi_air_detach(struct dummy_wifi_context *navi) {
+  spin_lock_bh(&nvf_air_lock);
+  if (navi->air != NULL) {
+    list_del_rcu(&navi->air_node);
+    WRITE_ONCE(navi->air, NULL);
+  }
+  spin_unlock_bh(&nvf_air_lock);
+}
+
+/**
+ * @brief Look up one of the supported channels by frequency.
+ *
+ * The bands are shared by all radios, so the channel can be used with any of
+ * their wiphys.
+ *
+ * @param freq Center frequency in MHz.
+ *
+ * @return The channel, or NULL if no supported band has a channel at
+ *         @p freq.
+ */
+static struct ieee80211_channel *nvf_get_channel(u32 freq) {
+  enum nl80211_band band;
+  int i;
+
+  for (band = 0; band < NUM_NL80211_BANDS; band++) {
+    if (nvf_bands[band] == NULL) {
+      continue;
+    }
+    for (i = 0; i < nvf_bands[band]->n_channels; i++) {
+      if (nvf_bands[band]->channels[i].center_freq == freq) {
+        return &nvf_bands[band]->channels[i];
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Get the n-th supported channel.
+ *
+ * Channels of all supported bands are numbered consecutively; @p n wraps
+ * around, which spreads generated access points over all channels.
+ *
+ * @param n Channel number.
+ *
+ * @return The channel.
+ */
+static struct ieee80211_channel *nvf_nth_channel(unsigned int n) {
+  unsigned int total = 0;
+  enum nl80211_band band;
+
+  for (band = 0; band < NUM_NL80211_BANDS; band++) {
+    total += nvf_bands[band] ? nvf_bands[band]->n_channels : 0;
+  }
+
+  n %= total;
+  for (band = 0; band < NUM_NL80211_BANDS; band++) {
+    if (nvf_bands[band] == NULL) {
+      continue;
+    }
+    if (n < nvf_bands[band]->n_channels) {
+      break;
+    }
+    n -= nvf_bands[band]->n_channels;
+  }
+
+  return &nvf_bands[band]->channels[n];
+}
+
+/**
+ * @brief Get the highest PHY rate on a channel.
+ *
+ * Uses the most recent PHY of the band (HE, VHT, HT or legacy) with all its
+ * spatial streams, the widest channel it supports and the short guard
+ * interval.
+ *
+ * @param chan Channel.
+ *
+ * @return The rate in kbit/s.
+ */
+static u32 nvf_channel_max_rate_kbps(const struct ieee80211_channel *chan) {
+  const struct ieee80211_supported_band *sband = nvf_bands[chan->band];
+  bool wide = chan->band != NL80211_BAND_2GHZ;
+  struct rate_info ri = {.nss = NVF_NSS};
+  u32 rate = 0;
+  int i;
+
+  if (ieee80211_get_he_iftype_cap(sband, NL80211_IFTYPE_STATION) != NULL) {
+    ri.flags = RATE_INFO_FLAGS_HE_MCS;
+    ri.mcs = 11;
+    ri.he_gi = NL80211_RATE_INFO_HE_GI_0_8;
+    ri.bw = wide ? RATE_INFO_BW_160 : RATE_INFO_BW_40;
+  } else if (sband->vht_cap.vht_supported) {
+    ri.flags = RATE_INFO_FLAGS_VHT_MCS | RATE_INFO_FLAGS_SHORT_GI;
+    ri.mcs = 9;
+    ri.bw = RATE_INFO_BW_160;
+  } else if (sband->ht_cap.ht_supported) {
+    ri.flags = RATE_INFO_FLAGS_MCS | RATE_INFO_FLAGS_SHORT_GI;
+    ri.mcs = NVF_NSS * 8 - 1;
+    ri.bw = RATE_INFO_BW_40;
+  } else {
+    for (i = 0; i < sband->n_bitrates; i++) {
+      rate = max_t(u32, rate, sband->bitrates[i].bitrate);
+    }
+    ri.legacy = rate;
+  }
+
+  // Bitrates are given in units of 100 kbit/s.
+  return cfg80211_calculate_bitrate(&ri) * 100;
+}
+
+/**
+ * @brief Allocate an empty BSS database.
+ *
+ * The entries and the IE blob share a single allocation.
+ *
+ * @param max_bss Number of access points the table can hold.
+ * @param ies_len Size of the IE blob.
+ *
+ * @return The table with one reference, or NULL if out of memory.
+ */
+static struct dummy_wifi_bss_table *
+dummy_wifi_bss_table_alloc(unsigned int max_bss, size_t ies_len) {
+  struct dummy_wifi_bss_table *table =
+      kvzalloc(size_add(struct_size(table, bss, max_bss), ies_len), GFP_KERNEL);
+
+  if (table != NULL) {
+    kref_init(&table->kref);
+    table->ies = (u8 *)&table->bss[max_bss];
+  }
+
+  return table;
+}
+
+/**
+ * @brief Get the value of a rate for the (Extended) Supported Rates IE.
+ *
+ * @param rate Rate of a supported band.
+ * @param band Band of the rate.
+ *
+ * @return The rate in units of 500 kbps, with the "basic rate" bit set for the
+ *         mandatory rates of the band.
+ */
+static u8 nvf_rate_ie_value(const struct ieee80211_rate *rate,
+                            enum nl80211_band band) {
+  bool basic = false;
+
+  switch (rate->bitrate) {
+  case 10:
+  case 20:
+  case 55:
+  case 110:
+    basic = band == NL80211_BAND_2GHZ;
+    break;
+  case 60:
+  case 120:
+  case 240:
+    basic = band != NL80211_BAND_2GHZ;
+    break;
+  }
+
+  return rate->bitrate / 5 | (basic ? 0x80 : 0);
+}
+
+/**
+ * @brief Serialize the IEs of an access point.
+ *
+ * Produces the SSID, (Extended) Supported Rates, DS Parameter Set, HT, VHT
+ * and HE Capabilities (when the band supports them) and RSN (WPA2-PSK with
+ * CCMP) elements an access point would put in its probe responses.
+ *
+ * @param bss Access point, its channel must be set.
+ * @param buf Buffer of at least NVF_BSS_IES_MAX bytes.
+ *
+ * @return Length of the IEs written to @p buf.
+ */
+static size_t dummy_wifi_bss_ies_build(const struct dummy_wifi_bss *bss,
+                                       u8 *buf) {
+  static const u8 rsn_ie[] = {
+      WLAN_EID_RSN, 20,                   /* element header */
+      0x01, 0x00,                         /* version 1 */
+      0x00, 0x0f, 0xac, 0x04,             /* group cipher: CCMP */
+      0x01, 0x00, 0x00, 0x0f, 0xac, 0x04, /* pairwise cipher: CCMP */
+      0x01, 0x00, 0x00, 0x0f, 0xac, 0x02, /* AKM: PSK */
+      0x00, 0x00,                         /* RSN capabilities */
+  };
+  const struct ieee80211_supported_band *sband = nvf_bands[bss->chan->band];
+  const struct ieee80211_sta_he_cap *he;
+  u8 *pos = buf;
+  int i;
+
+  *pos++ = WLAN_EID_SSID;
+  *pos++ = bss->ssid_len;
+  memcpy(pos, bss->ssid, bss->ssid_len);
+  pos += bss->ssid_len;
+
+  // The first eight rates go to Supported Rates, the others to Extended
+  // Supported Rates.
+  *pos++ = WLAN_EID_SUPP_RATES;
+  *pos++ = min(sband->n_bitrates, 8);
+  for (i = 0; i < sband->n_bitrates; i++) {
+    if (i == 8) {
+      *pos++ = WLAN_EID_EXT_SUPP_RATES;
+      *pos++ = sband->n_bitrates - 8;
+    }
+    *pos++ = nvf_rate_ie_value(&sband->bitrates[i], bss->chan->band);
+  }
+
+  if (bss->chan->band == NL80211_BAND_2GHZ) {
+    *pos++ = WLAN_EID_DS_PARAMS;
+    *pos++ = 1;
+    *pos++ = ieee80211_frequency_to_channel(bss->chan->center_freq);
+  }
+
+  if (sband->ht_cap.ht_supported) {
+    struct ieee80211_ht_cap ht = {
+        .cap_info = cpu_to_le16(sband->ht_cap.cap),
+        .ampdu_params_info = sband->ht_cap.ampdu_factor |
+                             (sband->ht_cap.ampdu_density
+                              << IEEE80211_HT_AMPDU_PARM_DENSITY_SHIFT),
+        .mcs = sband->ht_cap.mcs,
+    };
+
+    *pos++ = WLAN_EID_HT_CAPABILITY;
+    *pos++ = sizeof(ht);
+    memcpy(pos, &ht, sizeof(ht));
+    pos += sizeof(ht);
+  }
+
+  if (sband->vht_cap.vht_supported) {
+    struct ieee80211_vht_cap vht = {
+        .vht_cap_info = cpu_to_le32(sband->vht_cap.cap),
+        .supp_mcs = sband->vht_cap.vht_mcs,
+    };
+
+    *pos++ = WLAN_EID_VHT_CAPABILITY;
+    *pos++ = sizeof(vht);
+    memcpy(pos, &vht, sizeof(vht));
+    pos += sizeof(vht);
+  }
+
+  // The MCS/NSS sets that follow depend on the channel widths supported.
+  he = ieee80211_get_he_iftype_cap(sband, NL80211_IFTYPE_STATION);
+  if (he != NULL) {
+    u8 mcs_len = ieee80211_he_mcs_nss_size(&he->he_cap_elem);
+
+    *pos++ = WLAN_EID_EXTENSION;
+    *pos++ = 1 + sizeof(he->he_cap_elem) + mcs_len;
+    *pos++ = WLAN_EID_EXT_HE_CAPABILITY;
+    memcpy(pos, &he->he_cap_elem, sizeof(he->he_cap_elem));
+    pos += sizeof(he->he_cap_elem);
+    memcpy(pos, &he->he_mcs_nss_supp, mcs_len);
+    pos += mcs_len;
+  }
+
+  if (bss->flags & DUMMY_WIFI_BSS_RSN) {
+    memcpy(pos, rsn_ie, sizeof(rsn_ie));
+    pos += sizeof(rsn_ie);
+  }
+
+  return pos - buf;
+}
+
+/**
+ * @brief Free a BSS database once its last reference is gone.
+ *
+ * @param kref Pointer to the reference counter embedded in the table.
+ */
+static void dummy_wifi_bss_table_release(struct kref *kref) {
+  struct dummy_wifi_bss_table *table =
+      container_of(kref, struct dummy_wifi_bss_table, kref);
+
+  // Lockless readers may still be looking at it, wait for a grace period.
+  kvfree_rcu(table, rcu);
+}
+
+/**
+ * @brief Drop a reference to a BSS database.
+ *
+ * @param table Pointer to the table, may be NULL.
+ */
+static void dummy_wifi_bss_table_put(struct dummy_wifi_bss_table *table) {
+  if (table != NULL) {
+    kref_put(&table->kref, dummy_wifi_bss_table_release);
+  }
+}
+
+/**
+ * @brief Get a reference to the current BSS database of a radio.
+ *
+ * The returned table stays valid and unchanged until it is released with
+ * dummy_wifi_bss_table_put(), even if the radio switches to another table.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ *
+ * @return The table of the radio.
+ */
+static struct dummy_wifi_bss_table *
+dummy_wifi_bss_table_get(struct dummy_wifi_context *navi) {
+  struct dummy_wifi_bss_table *table;
+
+  rcu_read_lock();
+  do {
+    table = rcu_dereference(navi->bss_table);
+  } while (!kref_get_unless_zero(&table->kref));
+  rcu_read_unlock();
+
+  return table;
+}
+
+/**
+ * @brief Let a connected radio apply its roaming policy to a new BSS database.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ */
+static void dummy_wifi_roam_kick(struct dummy_wifi_context *navi) {
+  if (READ_ONCE(navi->roam_threshold) != 0 &&
+      (atomic_read(&navi->state) & DUMMY_WIFI_LINK_MASK) ==
+          DUMMY_WIFI_LINK_CONNECTED &&
+      atomic64_cmpxchg(&navi->roam_request, 0, NVF_ROAM_POLICY) == 0) {
+    queue_work(dummy_wifi_wq, &navi->ws_roam);
+  }
+}
+
+/**
+ * @brief Switch a radio to another BSS database.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param table New table, its reference is handed over to the radio.
+ */
+static void dummy_wifi_bss_table_replace(struct dummy_wifi_context *navi,
+                                         struct dummy_wifi_bss_table *table) {
+  struct dummy_wifi_bss_table *old;
+
+  mutex_lock(&navi->bss_lock);
+  old = rcu_replace_pointer(navi->bss_table, table,
+                            lockdep_is_held(&navi->bss_lock));
+  mutex_unlock(&navi->bss_lock);
+
+  dummy_wifi_bss_table_put(old);
+  dummy_wifi_roam_kick(navi);
+}
+
+/**
+ * @brief Compare two access points by BSSID, for sort().
+ *
+ * @param a First access point.
+ * @param b Second access point.
+ *
+ * @return <0, 0 or >0 like memcmp().
+ */
+static int dummy_wifi_bss_cmp(const void *a, const void *b) {
+  return memcmp(((const struct dummy_wifi_bss *)a)->bssid,
+                ((const struct dummy_wifi_bss *)b)->bssid, ETH_ALEN);
+}
+
+/**
+ * @brief Check whether two access points advertise the same content.
+ *
+ * The IEs are derived from the compared fields, so they need no comparison.
+ *
+ * @param a First access point.
+ * @param b Second access point.
+ *
+ * @return true if a scan would report them identically.
+ */
+static bool dummy_wifi_bss_same(const struct dummy_wifi_bss *a,
+                                const struct dummy_wifi_bss *b) {
+  return a->chan == b->chan && a->signal == b->signal &&
+         a->capability == b->capability && a->flags == b->flags &&
+         a->ssid_len == b->ssid_len &&
+         memcmp(a->ssid, b->ssid, a->ssid_len) == 0;
+}
+
+/**
+ * @brief Build a BSS database from an array of access points.
+ *
+ * The IEs of all access points are serialized once, back to back, into the
+ * blob of the table, so scans report them without rebuilding anything. The
+ * entries are sorted by BSSID. An entry identical to the entry of @p parent
+ * with the same BSSID inherits its generation; all others get a new one.
+ *
+ * @param bss Access points, their IE offset, length and generation are
+ *            ignored.
+ * @param n_bss Number of access points.
+ * @param parent Table being replaced, or NULL.
+ *
+ * @return The table with one reference, or an ERR_PTR() on failure (-EINVAL
+ *         if a BSSID is used twice).
+ */
+static struct dummy_wifi_bss_table *
+dummy_wifi_bss_table_build(const struct dummy_wifi_bss *bss,
+                           unsigned int n_bss,
+                           const struct dummy_wifi_bss_table *parent) {
+  struct dummy_wifi_bss_table *table;
+  struct dummy_wifi_bss *entry;
+  u8 scratch[NVF_BSS_IES_MAX];
+  size_t ies_len = 0, len;
+  unsigned int i, j = 0;
+
+  // First pass: size the blob.
+  for (i = 0; i < n_bss; i++) {
+    ies_len += dummy_wifi_bss_ies_build(&bss[i], scratch);
+  }
+
+  table = dummy_wifi_bss_table_alloc(n_bss, ies_len);
+  if (table == NULL) {
+    return ERR_PTR(-ENOMEM);
+  }
+
+  if (n_bss) {
+    memcpy(table->bss, bss, n_bss * sizeof(*bss));
+  }
+  sort(table->bss, n_bss, sizeof(*bss), dummy_wifi_bss_cmp, NULL);
+
+  // Second pass: serialize the IEs in place and assign the generations,
+  // walking the parent table alongside.
+  ies_len = 0;
+  for (i = 0; i < n_bss; i++) {
+    entry = &table->bss[i];
+    if (i && ether_addr_equal(entry->bssid, entry[-1].bssid)) {
+      dummy_wifi_bss_table_put(table);
+      return ERR_PTR(-EINVAL);
+    }
+
+    len = dummy_wifi_bss_ies_build(entry, table->ies + ies_len);
+    entry->ie_offset = ies_len;
+    entry->ie_len = len;
+    ies_len += len;
+
+    while (parent && j < parent->n_bss &&
+           dummy_wifi_bss_cmp(&parent->bss[j], entry) < 0) {
+      j++;
+    }
+    if (parent && j < parent->n_bss &&
+        ether_addr_equal(parent->bss[j].bssid, entry->bssid) &&
+        dummy_wifi_bss_same(&parent->bss[j], entry)) {
+      entry->gen = parent->bss[j].gen;
+    } else {
+      entry->gen = atomic_inc_return(&dummy_wifi_bss_gen);
+    }
+  }
+  table->n_bss = n_bss;
+
+  return table;
+}
+
+/**
+ * @brief Generate a synthetic BSS database.
+ *
+ * The first access point is the well-known dummy network (SSID_DUMMY with
+ * BSSID aa:bb:cc:dd:ee:ff). The others get a locally administered BSSID and
+ * an SSID derived from their index, are spread over all supported channels
+ * and get a pseudo-random signal between -30 and -90 dBm. Every other one is
+ * protected with WPA2-PSK.
+ *
+ * @param count Number of access points.
+ *
+ * @return The table with one reference, or an ERR_PTR() on failure.
+ */
+static struct dummy_wifi_bss_table *
+dummy_wifi_bss_table_generate(unsigned int count) {
+  static const u8 dummy_bssid[ETH_ALEN] = {0xaa, 0xbb, 0xcc,
+                                           0xdd, 0xee, 0xff};
+  struct dummy_wifi_bss_table *table;
+  struct dummy_wifi_bss *entries, *bss;
+  unsigned int i;
+
+  entries = kvcalloc(count, sizeof(*entries), GFP_KERNEL);
+  if (entries == NULL && count) {
+    return ERR_PTR(-ENOMEM);
+  }
+
+  for (i = 0; i < count; i++) {
+    bss = &entries[i];
+    bss->capability = WLAN_CAPABILITY_ESS;
+
+    if (i == 0) {
+      ether_addr_copy(bss->bssid, dummy_bssid);
+      bss->ssid_len = sizeof(SSID_DUMMY) - 1;
+      memcpy(bss->ssid, SSID_DUMMY, bss->ssid_len);
+      bss->chan = nvf_get_channel(2437); // Channel 6, as it always was.
+      bss->signal = -4500;
+      continue;
+    }
+
+    bss->bssid[0] = 0x02; // Locally administered, unicast.
+    bss->bssid[3] = i >> 16;
+    bss->bssid[4] = i >> 8;
+    bss->bssid[5] = i;
+    bss->ssid_len = scnprintf((char *)bss->ssid, sizeof(bss->ssid), "%s-%u",
+                              SSID_DUMMY, i);
+    bss->chan = nvf_nth_channel(i);
+    bss->signal = -3000 - (s32)(hash_32(i, 16) % 6001);
+    if (i % 2) {
+      bss->flags |= DUMMY_WIFI_BSS_RSN;
+      bss->capability |= WLAN_CAPABILITY_PRIVACY;
+    }
+  }
+
+  table = dummy_wifi_bss_table_build(entries, count, NULL);
+  kvfree(entries);
+
+  return table;
+}
+
+/**
+ * @brief Get the next whitespace separated token of a line.
+ *
+ * @param line Pointer to the remainder of the line, advanced past the token.
+ *
+ * @return The token, or NULL at the end of the line.
+ */
+static char *nvf_next_token(char **line) {
+  if (*line == NULL) {
+    return NULL;
+  }
+  *line = skip_spaces(*line);
+  return **line ? strsep(line, " \t") : NULL;
+}
+
+/**
+ * @brief Parse one line of a textual BSS database.
+ *
+ * Each line describes one access point:
+ *
+ *   <bssid> <frequency in MHz> <signal in dBm> <ssid>
+ *
+ * e.g. "aa:bb:cc:dd:ee:ff 2437 -45 MyAwesomeWiFi". The SSID is the rest of
+ * the line and may contain spaces. Empty lines and lines starting with '#'
+ * are ignored.
+ *
+ * @param line NUL terminated line, modified while parsing.
+ * @param bss Access point to fill.
+ *
+ * @return 1 if @p bss was filled, 0 if the line was ignored, -EINVAL if it is
+ *         malformed.
+ */
+static int dummy_wifi_bss_parse_line(char *line, struct dummy_wifi_bss *bss) {
+  char *tok;
+  u16 freq;
+  int signal;
+
+  line = strim(line);
+  if (*line == '\0' || *line == '#') {
+    return 0;
+  }
+
+  memset(bss, 0, sizeof(*bss));
+  bss->capability = WLAN_CAPABILITY_ESS;
+
+  tok = nvf_next_token(&line);
+  if (tok == NULL || strlen(tok) != 3 * ETH_ALEN - 1 ||
+      !mac_pton(tok, bss->bssid)) {
+    return -EINVAL;
+  }
+
+  tok = nvf_next_token(&line);
+  if (tok == NULL || kstrtou16(tok, 10, &freq)) {
+    return -EINVAL;
+  }
+  bss->chan = nvf_get_channel(freq);
+  if (bss->chan == NULL) {
+    return -EINVAL;
+  }
+
+  tok = nvf_next_token(&line);
+  if (tok == NULL || kstrtoint(tok, 10, &signal) || signal < -128 ||
+      signal > 0) {
+    return -EINVAL;
+  }
+  bss->signal = signal * 100;
+
+  line = line ? skip_spaces(line) : NULL;
+  if (line == NULL || *line == '\0' || strlen(line) > IEEE80211_MAX_SSID_LEN) {
+    return -EINVAL;
+  }
+  bss->ssid_len = strlen(line);
+  memcpy(bss->ssid, line, bss->ssid_len);
+
+  return 1;
+}
+
+/**
+ * @struct dummy_wifi_bss_loader
+ * @brief State of a textual BSS database being parsed.
+ *
+ * Data may arrive in arbitrary chunks (firmware blob, successive write()
+ * calls); complete lines are parsed as soon as they are seen.
+ */
+struct dummy_wifi_bss_loader {
+  struct dummy_wifi_bss *bss;       /**< Parsed access points. */
+  unsigned int n_bss;               /**< Number of parsed access points. */
+  unsigned int max_bss;             /**< Capacity of bss. */
+  size_t line_len;                  /**< Length of the partial line. */
+  char line[NVF_BSS_LINE_MAX + 1];  /**< Partial line, NUL terminated. */
+  int err;                          /**< First error seen, sticky. */
+};
+
+/**
+ * @brief Parse the line accumulated by a loader and append its entry.
+ *
+ * @param ld Pointer to the loader.
+ *
+ * @return 0 on success, a negative error code otherwise.
+ */
+static int dummy_wifi_bss_loader_add_line(struct dummy_wifi_bss_loader *ld) {
+  struct dummy_wifi_bss *bss;
+  unsigned int max_bss;
+  int ret;
+
+  ld->line[ld->line_len] = '\0';
+  ld->line_len = 0;
+
+  if (ld->n_bss == ld->max_bss) {
+    if (ld->max_bss == NVF_MAX_BSS) {
+      return -E2BIG;
+    }
+    max_bss = clamp(2 * ld->max_bss, 64U, (unsigned int)NVF_MAX_BSS);
+    bss = kvmalloc_array(max_bss, sizeof(*bss), GFP_KERNEL);
+    if (bss == NULL) {
+      return -ENOMEM;
+    }
+    if (ld->n_bss) {
+      memcpy(bss, ld->bss, ld->n_bss * sizeof(*bss));
+    }
+    kvfree(ld->bss);
+    ld->bss = bss;
+    ld->max_bss = max_bss;
+  }
+
+  ret = dummy_wifi_bss_parse_line(ld->line, &ld->bss[ld->n_bss]);
+  if (ret > 0) {
+    ld->n_bss++;
+  }
+
+  return ret < 0 ? ret : 0;
+}
+
+/**
+ * @brief Feed a chunk of a textual BSS database to a loader.
+ *
+ * @param ld Pointer to the loader.
+ * @param data Chunk of text.
+ * @param len Length of the chunk.
+ *
+ * @return 0 on success, a negative error code otherwise. Errors are sticky.
+ */
+static int dummy_wifi_bss_loader_feed(struct dummy_wifi_bss_loader *ld,
+                                      const char *data, size_t len) {
+  size_t i;
+
+  for (i = 0; i < len && ld->err == 0; i++) {
+    if (data[i] == '\n') {
+      ld->err = dummy_wifi_bss_loader_add_line(ld);
+    } else if (ld->line_len == NVF_BSS_LINE_MAX) {
+      ld->err = -EINVAL;
+    } else {
+      ld->line[ld->line_len++] = data[i];
+    }
+  }
+
+  return ld->err;
+}
+
+/**
+ * @brief Finish loading and build the BSS database.
+ *
+ * The loader is released in any case.
+ *
+ * @param ld Pointer to the loader.
+ * @param parent Table the new one replaces, or NULL.
+ *
+ * @return The table with one reference, or an ERR_PTR() on failure.
+ */
+static struct dummy_wifi_bss_table *
+dummy_wifi_bss_loader_finish(struct dummy_wifi_bss_loader *ld,
+                             const struct dummy_wifi_bss_table *parent) {
+  struct dummy_wifi_bss_table *table = NULL;
+
+  // The last line does not need a trailing newline.
+  if (ld->err == 0 && ld->line_len) {
+    ld->err = dummy_wifi_bss_loader_add_line(ld);
+  }
+
+  if (ld->err == 0) {
+    table = dummy_wifi_bss_table_build(ld->bss, ld->n_bss, parent);
+    if (IS_ERR(table)) {
+      ld->err = PTR_ERR(table);
+    }
+  }
+
+  kvfree(ld->bss);
+  ld->bss = NULL;
+
+  return ld->err ? ERR_PTR(ld->err) : table;
+}
+
+/**
+ * @brief Load a BSS database from a firmware file.
+ *
+ * @param name Name of the file, looked up in the firmware search path.
+ *
+ * @return The table with one reference, or an ERR_PTR() on failure.
+ */
+static struct dummy_wifi_bss_table *
+dummy_wifi_bss_table_load(const char *name) {
+  struct dummy_wifi_bss_loader *ld;
+  struct dummy_wifi_bss_table *table;
+  const struct firmware *fw;
+  int err;
+
+  ld = kzalloc(sizeof(*ld), GFP_KERNEL);
+  if (ld == NULL) {
+    return ERR_PTR(-ENOMEM);
+  }
+
+  err = request_firmware_direct(&fw, name, NULL);
+  if (err) {
+    kfree(ld);
+    return ERR_PTR(err);
+  }
+
+  dummy_wifi_bss_loader_feed(ld, fw->data, fw->size);
+  release_firmware(fw);
+
+  table = dummy_wifi_bss_loader_finish(ld, NULL);
+  kfree(ld);
+
+  return table;
+}
+
+/**
+ * @brief Show the BSS database of a radio in debugfs.
+ *
+ * The output uses the format accepted by dummy_wifi_bss_parse_line().
+ *
+ * @param m Sequential file to print to.
+ * @param v Unused iterator value.
+ *
+ * @return Always 0.
+ */
+static int dummy_wifi_bss_show(struct seq_file *m, void *v) {
+  struct dummy_wifi_bss_table *table = dummy_wifi_bss_table_get(m->private);
+  const struct dummy_wifi_bss *bss;
+
+  for (bss = table->bss; bss < table->bss + table->n_bss; bss++) {
+    seq_printf(m, "%pM %u %d %.*s\n", bss->bssid, bss->chan->center_freq,
+               bss->signal / 100, bss->ssid_len, bss->ssid);
+  }
+
+  dummy_wifi_bss_table_put(table);
+  return 0;
+}
+
+/**
+ * @brief Open the "bss" debugfs file of a radio.
+ *
+ * Opened for reading, the file lists the database. Opened for writing, it
+ * collects a new database which replaces the current one when the file is
+ * closed. Reading and writing at the same time is not supported.
+ *
+ * @param inode Inode of the file, its private data is the DummyWiFi context.
+ * @param file File being opened.
+ *
+ * @return 0 on success, a negative error code otherwise.
+ */
+static int dummy_wifi_bss_open(struct inode *inode, struct file *file) {
+  struct dummy_wifi_bss_loader *ld;
+
+  if (!(file->f_mode & FMODE_WRITE)) {
+    return single_open(file, dummy_wifi_bss_show, inode->i_private);
+  }
+  if (file->f_mode & FMODE_READ) {
+    return -EINVAL;
+  }
+
+  ld = kzalloc(sizeof(*ld), GFP_KERNEL);
+  if (ld == NULL) {
+    return -ENOMEM;
+  }
+  file->private_data = ld;
+
+  return 0;
+}
+
+/**
+ * @brief Write part of a new BSS database to the "bss" debugfs file.
+ *
+ * Complete lines are parsed right away, so a malformed line fails the write()
+ * that completes it; the database is then left unchanged on close.
+ *
+ * @param file File opened for writing.
+ * @param ubuf User buffer.
+ * @param count Number of bytes to write.
+ * @param ppos File position, advanced by @p count.
+ *
+ * @return @p count on success, a negative error code otherwise.
+ */
+static ssize_t dummy_wifi_bss_write(struct file *file, const char __user *ubuf,
+                                    size_t count, loff_t *ppos) {
+  struct dummy_wifi_bss_loader *ld = file->private_data;
+  char chunk[256];
+  size_t done, len;
+  int err;
+
+  for (done = 0; done < count; done += len) {
+    len = min(count - done, sizeof(chunk));
+    if (copy_from_user(chunk, ubuf + done, len)) {
+      ld->err = -EFAULT;
+      return -EFAULT;
+    }
+    err = dummy_wifi_bss_loader_feed(ld, chunk, len);
+    if (err) {
+      return err;
+    }
+  }
+
+  *ppos += count;
+  return count;
+}
+
+/**
+ * @brief Close the "bss" debugfs file.
+ *
+ * After a successful write session the collected database replaces the one
+ * of the radio.
+ *
+ * @param inode Inode of the file, its private data is the DummyWiFi context.
+ * @param file File being closed.
+ *
+ * @return Always 0.
+ */
+static int dummy_wifi_bss_release(struct inode *inode, struct file *file) {
+  struct dummy_wifi_context *navi = inode->i_private;
+  struct dummy_wifi_bss_loader *ld = file->private_data;
+  struct dummy_wifi_bss_table *parent, *table;
+
+  if (!(file->f_mode & FMODE_WRITE)) {
+    return single_release(inode, file);
+  }
+
+  // The radio cannot go away while we hold the debugfs file.
+  if (debugfs_file_get(file->f_path.dentry) == 0) {
+    // Unchanged access points keep their generation.
+    parent = dummy_wifi_bss_table_get(navi);
+    table = dummy_wifi_bss_loader_finish(ld, parent);
+    dummy_wifi_bss_table_put(parent);
+    if (!IS_ERR(table)) {
+      dummy_wifi_bss_table_replace(navi, table);
+    }
+    debugfs_file_put(file->f_path.dentry);
+  } else {
+    dummy_wifi_bss_table_put(dummy_wifi_bss_loader_finish(ld, NULL));
+  }
+  kfree(ld);
+
+  return 0;
+}
+
+/**
+ * @brief Seek in the "bss" debugfs file, only supported when reading.
+ *
+ * @param file File being sought.
+ * @param offset Offset.
+ * @param whence Origin of the offset.
+ *
+ * @return The new position, or -ESPIPE when the file is opened for writing.
+ */
+static loff_t dummy_wifi_bss_llseek(struct file *file, loff_t offset,
+                                    int whence) {
+  if (file->f_mode & FMODE_WRITE) {
+    return -ESPIPE;
+  }
+  return seq_lseek(file, offset, whence);
+}
+
+static const struct file_operations dummy_wifi_bss_fops = {
+    .owner = THIS_MODULE,
+    .open = dummy_wifi_bss_open,
+    .read = seq_read,
+    .write = dummy_wifi_bss_write,
+    .llseek = dummy_wifi_bss_llseek,
+    .release = dummy_wifi_bss_release,
+};
+
+/**
+ * @struct dummy_wifi_bss_batch
+ * @brief Working copy of a BSS database edited by a batch of commands.
+ *
+ * The first n_base entries are copied from the current table and stay sorted
+ * by BSSID, so they are found by binary search; added access points are
+ * appended after them and found through a hash table, so a batch costs
+ * O(n log n) whatever its size. Removed entries keep their slot without a
+ * channel.
+ */
+struct dummy_wifi_bss_batch {
+  struct dummy_wifi_bss *bss; /**< Access points, removed ones included. */
+  unsigned int n_bss;         /**< Number of used entries of bss. */
+  unsigned int n_base;        /**< Entries copied from the current table. */
+  u32 *added;                 /**< Appended entries hashed by BSSID, with
+                                   linear probing: index in bss plus one, 0
+                                   for a free slot. At most half full. */
+  unsigned int added_bits;    /**< log2 of the number of slots of added. */
+  unsigned int n_live;        /**< Entries that are not removed. */
+  bool dirty;                 /**< The access points were modified. */
+  bool set_dwell;             /**< dwell_us must be applied. */
+  u32 dwell_us;               /**< New scan dwell time per channel. */
+};
+
+/**
+ * @brief Find an access point in a batch by BSSID, removed ones included.
+ *
+ * @param batch Pointer to the batch.
+ * @param bssid BSSID to look up.
+ *
+ * @return The entry, or NULL if the batch never held this BSSID.
+ */
+static struct dummy_wifi_bss *
+dummy_wifi_bss_batch_find(struct dummy_wifi_bss_batch *batch,
+                          const u8 *bssid) {
+  u32 mask = (1U << batch->added_bits) - 1;
+  struct dummy_wifi_bss key, *bss;
+  u32 h;
+
+  ether_addr_copy(key.bssid, bssid);
+  bss = bsearch(&key, batch->bss, batch->n_base, sizeof(key),
+                dummy_wifi_bss_cmp);
+  if (bss != NULL) {
+    return bss;
+  }
+
+  for (h = hash_64(ether_addr_to_u64(bssid), batch->added_bits);
+       batch->added[h] != 0; h = (h + 1) & mask) {
+    bss = &batch->bss[batch->added[h] - 1];
+    if (ether_addr_equal(bss->bssid, bssid)) {
+      return bss;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Append an access point to a batch.
+ *
+ * The BSSID must not be in the batch yet, see dummy_wifi_bss_batch_find().
+ *
+ * @param batch Pointer to the batch.
+ * @param bssid BSSID of the new access point.
+ *
+ * @return The new entry, to be filled in by the caller.
+ */
+static struct dummy_wifi_bss *
+dummy_wifi_bss_batch_append(struct dummy_wifi_bss_batch *batch,
+                            const u8 *bssid) {
+  u32 mask = (1U << batch->added_bits) - 1;
+  u32 h = hash_64(ether_addr_to_u64(bssid), batch->added_bits);
+
+  while (batch->added[h] != 0) {
+    h = (h + 1) & mask;
+  }
+  batch->added[h] = batch->n_bss + 1;
+
+  return &batch->bss[batch->n_bss++];
+}
+
+/**
+ * @brief Parse a BSSID argument and find its access point in a batch.
+ *
+ * @param batch Pointer to the batch.
+ * @param line Pointer to the remainder of the command, advanced past the
+ *             BSSID.
+ *
+ * @return The entry, or an ERR_PTR() (-EINVAL if the BSSID is malformed,
+ *         -ENOENT if there is no such access point).
+ */
+static struct dummy_wifi_bss *
+dummy_wifi_bss_batch_lookup(struct dummy_wifi_bss_batch *batch, char **line) {
+  struct dummy_wifi_bss *bss;
+  u8 bssid[ETH_ALEN];
+  char *tok;
+
+  tok = nvf_next_token(line);
+  if (tok == NULL || strlen(tok) != 3 * ETH_ALEN - 1 ||
+      !mac_pton(tok, bssid)) {
+    return ERR_PTR(-EINVAL);
+  }
+
+  bss = dummy_wifi_bss_batch_find(batch, bssid);
+  return bss != NULL && bss->chan != NULL ? bss : ERR_PTR(-ENOENT);
+}
+
+/**
+ * @brief Execute one command of a batch on its working copy.
+ *
+ * The commands are:
+ *
+ *   add <bssid> <frequency in MHz> <signal in dBm> <ssid>
+ *   del <bssid>
+ *   signal <bssid> <signal in dBm>
+ *   clear
+ *   dwell <dwell time per channel in us>
+ *
+ * "add" replaces the access point if the BSSID is already known. Empty lines
+ * and lines starting with '#' are ignored.
+ *
+ * @param batch Pointer to the batch.
+ * @param line NUL terminated command, modified while parsing.
+ *
+ * @return 1 if a command was executed, 0 if the line was ignored, a negative
+ *         error code otherwise.
+ */
+static int dummy_wifi_bss_batch_exec(struct dummy_wifi_bss_batch *batch,
+                                     char *line) {
+  struct dummy_wifi_bss entry, *bss;
+  unsigned int i;
+  char *cmd, *tok;
+  int signal;
+
+  line = strim(line);
+  if (*line == '\0' || *line == '#') {
+    return 0;
+  }
+  cmd = nvf_next_token(&line);
+
+  if (strcmp(cmd, "add") == 0) {
+    if (line == NULL || dummy_wifi_bss_parse_line(line, &entry) <= 0) {
+      return -EINVAL;
+    }
+    bss = dummy_wifi_bss_batch_find(batch, entry.bssid);
+    if (bss == NULL || bss->chan == NULL) {
+      if (batch->n_live == NVF_MAX_BSS) {
+        return -E2BIG;
+      }
+      batch->n_live++;
+    }
+    if (bss == NULL) {
+      bss = dummy_wifi_bss_batch_append(batch, entry.bssid);
+    }
+    *bss = entry;
+    batch->dirty = true;
+    return 1; // The SSID took the rest of the line.
+  } else if (strcmp(cmd, "del") == 0) {
+    bss = dummy_wifi_bss_batch_lookup(batch, &line);
+    if (IS_ERR(bss)) {
+      return PTR_ERR(bss);
+    }
+    bss->chan = NULL;
+    batch->n_live--;
+  } else if (strcmp(cmd, "signal") == 0) {
+    bss = dummy_wifi_bss_batch_lookup(batch, &line);
+    if (IS_ERR(bss)) {
+      return PTR_ERR(bss);
+    }
+    tok = nvf_next_token(&line);
+    if (tok == NULL || kstrtoint(tok, 10, &signal) || signal < -128 ||
+        signal > 0) {
+      return -EINVAL;
+    }
+    bss->signal = signal * 100;
+  } else if (strcmp(cmd, "clear") == 0) {
+    for (i = 0; i < batch->n_bss; i++) {
+      batch->bss[i].chan = NULL;
+    }
+    batch->n_live = 0;
+  } else if (strcmp(cmd, "dwell") == 0) {
+    tok = nvf_next_token(&line);
+    if (tok == NULL || kstrtou32(tok, 10, &batch->dwell_us)) {
+      return -EINVAL;
+    }
+    batch->set_dwell = true;
+    return nvf_next_token(&line) == NULL ? 1 : -EINVAL;
+  } else {
+    return -EINVAL;
+  }
+
+  batch->dirty = true;
+  return nvf_next_token(&line) == NULL ? 1 : -EINVAL;
+}
+
+/**
+ * @brief Apply a batch of commands to the BSS database of a radio.
+ *
+ * The commands edit a copy of the current database; if they all succeed, a
+ * single new table replaces it, so scans never see half a batch. Otherwise
+ * nothing changes. Unchanged access points keep their generation and are
+ * not reported again by incremental scans.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param buf NUL terminated commands, one per line, modified while parsing.
+ * @param n_lines Upper bound for the number of lines of @p buf.
+ *
+ * @return 0 on success, a negative error code otherwise.
+ */
+static int dummy_wifi_bss_batch_apply(struct dummy_wifi_context *navi,
+                                      char *buf, unsigned int n_lines) {
+  struct dummy_wifi_bss_table *cur, *table;
+  struct dummy_wifi_bss_batch batch = {};
+  unsigned int n_cmds = 0, i, n = 0;
+  u64 start = ktime_get_ns();
+  char *line;
+  int ret = 0;
+
+  mutex_lock(&navi->bss_lock);
+  cur = rcu_dereference_protected(navi->bss_table,
+                                  lockdep_is_held(&navi->bss_lock));
+
+  // Each line adds at most one access point.
+  batch.bss = kvmalloc_array(cur->n_bss + n_lines, sizeof(*batch.bss),
+                             GFP_KERNEL);
+  batch.added_bits = order_base_2(2 * n_lines);
+  batch.added = kvcalloc(1U << batch.added_bits, sizeof(*batch.added),
+                         GFP_KERNEL);
+  if (batch.bss == NULL || batch.added == NULL) {
+    ret = -ENOMEM;
+    goto l_out;
+  }
+  if (cur->n_bss) {
+    memcpy(batch.bss, cur->bss, cur->n_bss * sizeof(*batch.bss));
+  }
+  batch.n_bss = batch.n_base = batch.n_live = cur->n_bss;
+
+  while (buf != NULL && ret >= 0) {
+    line = strsep(&buf, "\n");
+    ret = dummy_wifi_bss_batch_exec(&batch, line);
+    n_cmds += ret > 0;
+  }
+  if (ret < 0) {
+    goto l_out;
+  }
+  ret = 0;
+
+  if (batch.dirty) {
+    for (i = 0; i < batch.n_bss; i++) {
+      if (batch.bss[i].chan != NULL) {
+        batch.bss[n++] = batch.bss[i];
+      }
+    }
+    table = dummy_wifi_bss_table_build(batch.bss, n, cur);
+    if (IS_ERR(table)) {
+      ret = PTR_ERR(table);
+      goto l_out;
+    }
+    rcu_assign_pointer(navi->bss_table, table);
+  }
+  if (batch.set_dwell) {
+    WRITE_ONCE(navi->scan_dwell_us, batch.dwell_us);
+  }
+
+l_out:
+  if (ret == 0) {
+    navi->bss_ctl_batches++;
+    navi->bss_ctl_cmds += n_cmds;
+    start = ktime_get_ns() - start;
+    navi->bss_ctl_ns += start;
+    navi->bss_ctl_max_ns = max(navi->bss_ctl_max_ns, start);
+  } else {
+    navi->bss_ctl_rejected++;
+  }
+  mutex_unlock(&navi->bss_lock);
+
+  kvfree(batch.added);
+  kvfree(batch.bss);
+  if (ret == 0 && batch.dirty) {
+    dummy_wifi_bss_table_put(cur);
+    dummy_wifi_roam_kick(navi);
+  }
+
+  return ret;
+}
+
+/**
+ * @brief Show the statistics of the "bss_ctl" debugfs file of a radio.
+ *
+ * @param m Sequential file to print to.
+ * @param v Unused iterator value.
+ *
+ * @return Always 0.
+ */
+static int dummy_wifi_bss_ctl_show(struct seq_file *m, void *v) {
+  struct dummy_wifi_context *navi = m->private;
+
+  mutex_lock(&navi->bss_lock);
+  seq_printf(m, "batches: %llu\n", navi->bss_ctl_batches);
+  seq_printf(m, "commands: %llu\n", navi->bss_ctl_cmds);
+  seq_printf(m, "rejected: %llu\n", navi->bss_ctl_rejected);
+  seq_printf(m, "apply_ns: %llu\n", navi->bss_ctl_ns);
+  seq_printf(m, "apply_max_ns: %llu\n", navi->bss_ctl_max_ns);
+  mutex_unlock(&navi->bss_lock);
+
+  return 0;
+}
+
+/**
+ * @brief Open the "bss_ctl" debugfs file of a radio.
+ *
+ * @param inode Inode of the file, its private data is the DummyWiFi context.
+ * @param file File being opened.
+ *
+ * @return 0 on success, a negative error code otherwise.
+ */
+static int dummy_wifi_bss_ctl_open(struct inode *inode, struct file *file) {
+  return single_open(file, dummy_wifi_bss_ctl_show, inode->i_private);
+}
+
+/**
+ * @brief Apply a batch of commands written to the "bss_ctl" debugfs file.
+ *
+ * Each write() is one batch, see dummy_wifi_bss_batch_exec() for the
+ * commands. A batch fails as a whole.
+ *
+ * @param file File opened for writing.
+ * @param ubuf User buffer holding the commands, one per line.
+ * @param count Number of bytes to write.
+ * @param ppos Unused file position.
+ *
+ * @return @p count on success, a negative error code otherwise.
+ */
+static ssize_t dummy_wifi_bss_ctl_write(struct file *file,
+                                        const char __user *ubuf, size_t count,
+                                        loff_t *ppos) {
+  struct seq_file *m = file->private_data;
+  unsigned int n_lines = 1;
+  size_t i;
+  char *buf;
+  int err;
+
+  if (count > NVF_BSS_CTL_MAX) {
+    return -E2BIG;
+  }
+
+  buf = kvmalloc(count + 1, GFP_KERNEL);
+  if (buf == NULL) {
+    return -ENOMEM;
+  }
+  if (copy_from_user(buf, ubuf, count)) {
+    kvfree(buf);
+    return -EFAULT;
+  }
+  buf[count] = '\0';
+
+  for (i = 0; i < count; i++) {
+    n_lines += buf[i] == '\n';
+  }
+
+  err = dummy_wifi_bss_batch_apply(m->private, buf, n_lines);
+  kvfree(buf);
+
+  return err ? err : count;
+}
+
+static const struct file_operations dummy_wifi_bss_ctl_fops = {
+    .owner = THIS_MODULE,
+    .open = dummy_wifi_bss_ctl_open,
+    .read = seq_read,
+    .write = dummy_wifi_bss_ctl_write,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+/**
+ * @brief Find the access point to connect to.
+ *
+ * Among the access points advertising @p ssid (and @p bssid when given), the
+ * one with the strongest signal is selected.
+ *
+ * @param table BSS database to search.
+ * @param ssid SSID of the ESS.
+ * @param ssid_len Length of the SSID.
+ * @param bssid Requested BSSID, or NULL for any.
+ *
+ * @return The access point, or NULL if none matches.
+ */
+static const struct dummy_wifi_bss *
+dummy_wifi_bss_find(const struct dummy_wifi_bss_table *table, const u8 *ssid,
+                    u8 ssid_len, const u8 *bssid) {
+  const struct dummy_wifi_bss *bss, *best = NULL;
+
+  for (bss = table->bss; bss < table->bss + table->n_bss; bss++) {
+    if (bss->ssid_len != ssid_len || memcmp(bss->ssid, ssid, ssid_len) != 0) {
+      continue;
+    }
+    if (bssid != NULL && !ether_addr_equal(bss->bssid, bssid)) {
+      continue;
+    }
+    if (best == NULL || bss->signal > best->signal) {
+      best = bss;
+    }
+  }
+
+  return best;
+}
+
+/**
+ * @brief Pick the access point a connected radio should roam to.
+ *
+ * The candidates are the other access points of the ESS of the radio, the
+ * strongest one is selected. With NVF_ROAM_TARGET only the requested BSSID
+ * is a candidate. With NVF_ROAM_POLICY the radio only roams when the signal
+ * of its access point dropped below roam_threshold and the candidate is at
+ * least roam_hysteresis stronger, or when its access point disappeared.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param table BSS database to search.
+ * @param req Roam request, see NVF_ROAM_POLICY.
+ *
+ * @return The access point, or NULL if the radio should not roam.
+ */
+static const struct dummy_wifi_bss *
+dummy_wifi_roam_candidate(struct dummy_wifi_context *navi,
+                          const struct dummy_wifi_bss_table *table, u64 req) {
+  const struct dummy_wifi_bss *bss, *cur = NULL, *best = NULL;
+  s32 threshold = READ_ONCE(navi->roam_threshold) * 100;
+  s32 hysteresis = READ_ONCE(navi->roam_hysteresis) * 100;
+  u8 target[ETH_ALEN];
+
+  u64_to_ether_addr(req & NVF_ROAM_BSSID, target);
+
+  for (bss = table->bss; bss < table->bss + table->n_bss; bss++) {
+    if (bss->ssid_len != navi->connecting_ssid_len ||
+        memcmp(bss->ssid, navi->connecting_ssid, bss->ssid_len) != 0) {
+      continue;
+    }
+    if (ether_addr_equal(bss->bssid, navi->connected_bssid)) {
+      cur = bss;
+      continue;
+    }
+    if ((req & NVF_ROAM_TARGET) && !ether_addr_equal(bss->bssid, target)) {
+      continue;
+    }
+    if (best == NULL || bss->signal > best->signal) {
+      best = bss;
+    }
+  }
+
+  if (!(req & NVF_ROAM_POLICY) || best == NULL) {
+    return best;
+  }
+  if (threshold == 0) {
+    return NULL;
+  }
+  if (cur == NULL) {
+    return best;
+  }
+  return cur->signal < threshold && best->signal >= cur->signal + hysteresis
+             ? best
+             : NULL;
+}
+
+/**
+ * @brief Inform the kernel about a dummy BSS (Basic Service Set).
+ *
+ * This function informs the Linux kernel about the presence of a dummy BSS
+ * (Basic Service Set) for a wireless network interface. It provides information
+ * about the BSS, such as its channel, signal strength, BSSID, and other
+ * details. The IEs were serialized when the table was built.
+ *
+ * @param navi Pointer to the navigation context structure.
+ * @param table BSS database holding the access point.
+ * @param entry Access point of the BSS database to report.
+ */
+static void inform_dummy_bss(struct dummy_wifi_context *navi,
+                             const struct dummy_wifi_bss_table *table,
+                             const struct dummy_wifi_bss *entry) {
+  struct cfg80211_bss *bss = NULL;
+
+  // Define the information about the BSS.
+  struct cfg80211_inform_bss data = {
+      .chan = entry->chan,
+      /* signal "type" is set to mBm (wiphy->signal_type) before wiphy
+         registration */
+      .signal = entry->signal,
+  };
+
+  /* It is also possible to use cfg80211_inform_bss() instead of
+     cfg80211_inform_bss_data() */
+  // Inform the kernel about the BSS with the provided data.
+  bss = cfg80211_inform_bss_data(navi->wiphy, &data, CFG80211_BSS_FTYPE_UNKNOWN,
+                                 entry->bssid, 0, entry->capability,
+                                 NVF_BEACON_INTERVAL,
+                                 table->ies + entry->ie_offset, entry->ie_len,
+                                 GFP_KERNEL);
+
+  /* Free the cfg80211_bss structure. The refcounter of the structure
+     should be decremented if it's not used. */
+  cfg80211_put_bss(navi->wiphy, bss);
+}
+
+/**
+ * @brief Remove an access point from the cfg80211 BSS list.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param entry Access point that disappeared from the BSS database.
+ */
+static void unlink_dummy_bss(struct dummy_wifi_context *navi,
+                             const struct dummy_wifi_bss *entry) {
+  struct cfg80211_bss *bss =
+      cfg80211_get_bss(navi->wiphy, entry->chan, entry->bssid, entry->ssid,
+                       entry->ssid_len, IEEE80211_BSS_TYPE_ANY,
+                       IEEE80211_PRIVACY_ANY);
+
+  if (bss != NULL) {
+    cfg80211_unlink_bss(navi->wiphy, bss);
+    cfg80211_put_bss(navi->wiphy, bss);
+  }
+}
+
+/**
+ * @brief Report the BSS database of a radio to the kernel.
+ *
+ * The current table is walked in a single pass alongside the table reported
+ * by the previous scan (both are sorted by BSSID). Only access points that
+ * are new or whose generation changed are informed, and access points that
+ * disappeared are unlinked, which keeps BSS list churn and netlink traffic
+ * proportional to the changes. A full report informs every access point; it
+ * is done periodically, before cfg80211 expires unchanged entries, and when
+ * the scan flushes the BSS list. The time it takes is accounted in the scan
+ * statistics of the radio.
+ *
+ * Only called from the scan routine, which owns dummy_wifi_context::
+ * bss_reported.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param full Inform every access point, not only the changed ones.
+ */
+static void inform_dummy_bss_table(struct dummy_wifi_context *navi,
+                                   bool full) {
+  struct dummy_wifi_bss_table *table = dummy_wifi_bss_table_get(navi);
+  const struct dummy_wifi_bss_table *old = navi->bss_reported;
+  const struct dummy_wifi_bss *bss = table->bss, *end = bss + table->n_bss;
+  const struct dummy_wifi_bss *prev = NULL, *prev_end = NULL;
+  u64 start = ktime_get_ns(), elapsed, informed = 0, unlinked = 0;
+  int cmp;
+
+  if (old != NULL) {
+    prev = old->bss;
+    prev_end = prev + old->n_bss;
+  }
+
+  while (bss < end || prev < prev_end) {
+    if (bss == end) {
+      cmp = 1;
+    } else if (prev == prev_end) {
+      cmp = -1;
+    } else {
+      cmp = dummy_wifi_bss_cmp(bss, prev);
+    }
+    if (cmp > 0) {
+      // Gone since the previous scan.
+      unlink_dummy_bss(navi, prev++);
+      unlinked++;
+      continue;
+    }
+    if (full || cmp < 0 || bss->gen != prev->gen) {
+      inform_dummy_bss(navi, table, bss);
+      informed++;
+    }
+    if (cmp == 0) {
+      prev++;
+    }
+    bss++;
+  }
+
+  // Remember what the kernel knows now; the reference moves over.
+  navi->bss_reported = table;
+  dummy_wifi_bss_table_put((struct dummy_wifi_bss_table *)old);
+
+  // Only the scan routine of the radio updates the statistics.
+  elapsed = ktime_get_ns() - start;
+  WRITE_ONCE(navi->scan_count, navi->scan_count + 1);
+  WRITE_ONCE(navi->scan_bss_reported, navi->scan_bss_reported + informed);
+  WRITE_ONCE(navi->scan_bss_unlinked, navi->scan_bss_unlinked + unlinked);
+  WRITE_ONCE(navi->scan_inform_ns, navi->scan_inform_ns + elapsed);
+  if (elapsed > navi->scan_inform_max_ns) {
+    WRITE_ONCE(navi->scan_inform_max_ns, elapsed);
+  }
+}
+
+/**
+ * @brief Record that cfg80211 requested an operation of a radio.
+ *
+ * The work item of the operation is queued right away, except for scans
+ * which dwell on the channels first, see nvf_op_queued().
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param op Operation.
+ */
+static void nvf_op_request(struct dummy_wifi_context *navi, enum nvf_op op) {
+  struct nvf_op_stats *s = &navi->ops[op];
+
+  s->requested_ns = s->queued_ns = ktime_get_ns();
+  WRITE_ONCE(s->aborted_ns, 0);
+  trace_dummywifi_op_request(navi->idx, op);
+}
+
+/**
+ * @brief Record that cfg80211 aborted the operation in progress.
+ *
+ * Nothing is recorded once the work item has decided the outcome of the
+ * operation, see nvf_op_report().
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param op Operation.
+ *
+ * @return true if the operation is aborted, false if it completes anyway.
+ */
+static bool nvf_op_abort(struct dummy_wifi_context *navi, enum nvf_op op) {
+  if (cmpxchg64(&navi->ops[op].aborted_ns, 0, ktime_get_ns()) != 0) {
+    return false;
+  }
+  trace_dummywifi_op_abort(navi->idx, op);
+
+  return true;
+}
+
+/**
+ * @brief Decide the outcome of an operation that can be aborted.
+ *
+ * Aborts arriving later are ignored by nvf_op_abort(), so an operation is
+ * traced and timed as aborted only when it actually reports an abort.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param op Operation.
+ *
+ * @return true if the operation was aborted before.
+ */
+static bool nvf_op_report(struct dummy_wifi_context *navi, enum nvf_op op) {
+  return cmpxchg64(&navi->ops[op].aborted_ns, 0, NVF_OP_REPORTING) != 0;
+}
+
+/**
+ * @brief Record that the work item of an operation was queued.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param op Operation.
+ */
+static void nvf_op_queued(struct dummy_wifi_context *navi, enum nvf_op op) {
+  navi->ops[op].queued_ns = ktime_get_ns();
+}
+
+/**
+ * @brief Count a latency in a histogram of an operation.
+ *
+ * @param s Timings of the operation.
+ * @param phase Phase the latency was measured for.
+ * @param ns Latency.
+ */
+static void nvf_op_hist_add(struct nvf_op_stats *s, enum nvf_op_phase phase,
+                            u64 ns) {
+  unsigned int k = ns > 1 ? min_t(unsigned int, ilog2(ns),
+                                  NVF_HIST_BUCKETS - 1)
+                          : 0;
+
+  WRITE_ONCE(s->hist[phase][k], s->hist[phase][k] + 1);
+}
+
+/**
+ * @brief Record that the work item of an operation started running.
+ *
+ * The request time is copied into @p t: once the operation moves the link
+ * state, cfg80211 may request the next one before this one is done.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param op Operation.
+ * @param t Timings of the operation, for nvf_op_done().
+ */
+static void nvf_op_start(struct dummy_wifi_context *navi, enum nvf_op op,
+                         struct nvf_op_timing *t) {
+  struct nvf_op_stats *s = &navi->ops[op];
+
+  t->requested_ns = s->requested_ns;
+  t->start_ns = ktime_get_ns();
+  nvf_op_hist_add(s, NVF_PHASE_QUEUE, t->start_ns - s->queued_ns);
+  trace_dummywifi_op_start(navi->idx, op, t->start_ns - s->queued_ns);
+}
+
+/**
+ * @brief Record that an operation completed.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param op Operation.
+ * @param t Timings filled in by nvf_op_start().
+ * @param result 0 on success, a negative error code otherwise.
+ */
+static void nvf_op_done(struct dummy_wifi_context *navi, enum nvf_op op,
+                        const struct nvf_op_timing *t, int result) {
+  struct nvf_op_stats *s = &navi->ops[op];
+  u64 now = ktime_get_ns();
+  u64 exec_ns = now - t->start_ns - t->report_ns;
+
+  nvf_op_hist_add(s, NVF_PHASE_EXEC, exec_ns);
+  nvf_op_hist_add(s, NVF_PHASE_REPORT, t->report_ns);
+  nvf_op_hist_add(s, NVF_PHASE_TOTAL, now - t->requested_ns);
+  if (result == -ECANCELED && s->aborted_ns != 0 &&
+      s->aborted_ns != NVF_OP_REPORTING) {
+    nvf_op_hist_add(s, NVF_PHASE_ABORT, now - s->aborted_ns);
+  }
+  trace_dummywifi_op_done(navi->idx, op, now - t->requested_ns, exec_ns,
+                          t->report_ns, result);
+}
+
+/**
+ * @brief Record that a radio rejected an operation as busy.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param op Operation.
+ */
+static void nvf_op_busy(struct dummy_wifi_context *navi, enum nvf_op op) {
+  atomic_long_inc(&navi->state_busy);
+  trace_dummywifi_op_busy(navi->idx, op, atomic_read(&navi->state));
+}
+
+/**
+ * @brief Atomically move the link state of a radio.
+ *
+ * The transition only happens when the current link state is @p from; the
+ * scanning flag is preserved. Lost races against concurrent updates of the
+ * state word are counted in dummy_wifi_context::state_retries.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param from Expected current link state.
+ * @param to New link state.
+ *
+ * @return true if the transition was performed, false if the link state was
+ *         not @p from.
+ */
+static bool dummy_wifi_link_transition(struct dummy_wifi_context *navi,
+                                       enum dummy_wifi_link_state from,
+                                       enum dummy_wifi_link_state to) {
+  int old = atomic_read(&navi->state);
+
+  do {
+    if ((old & DUMMY_WIFI_LINK_MASK) != from) {
+      return false;
+    }
+  } while (!atomic_try_cmpxchg(&navi->state, &old,
+                               (old & ~DUMMY_WIFI_LINK_MASK) | to) &&
+           (atomic_long_inc(&navi->state_retries), true));
+
+  return true;
+}
+
+/**
+ * @brief This function is a routine for performing a Wi-Fi scan in the dummy
+ * context.
+ * "Scan" routine for DEMO. It just inform the kernel about "dummy" BSS and
+ * "finishs" scan. When scan is done it should call cfg80211_scan_done() to
+ * inform the kernel that scan is finished. This routine called through
+ * workqueue, when the kernel asks about scan through cfg80211_ops.
+ *
+ * The routine owns the scan while DUMMY_WIFI_STATE_SCANNING is set and always
+ * completes it; the flag is released last, after the request was reported.
+ *
+ * @param w A pointer to a work_struct representing the work to be done.
+ */
+static void dummy_wifi_scan_routine(struct work_struct *w) {
+  // Retrieve the dummy context from the work_struct using container_of
+  struct dummy_wifi_context *navi =
+      container_of(w, struct dummy_wifi_context, ws_scan);
+
+  // Create a structure to hold scan information, initialize 'aborted' to false
+  struct cfg80211_scan_info info = {};
+  struct nvf_op_timing t;
+  bool full;
+
+  nvf_op_start(navi, NVF_OP_SCAN, &t);
+
+  /* if scan was aborted by user (calling cfg80211_ops->abort_scan) or by
+     any driver/hardware issue - field should be set to "true". An abort
+     arriving from now on no longer counts, the scan completes normally. */
+  info.aborted = nvf_op_report(navi, NVF_OP_SCAN);
+
+  /* The dwell time on the channels was already emulated by scan_timer, the
+   * routine runs once the last channel has been "scanned", or right away
+   * when nvf_abort_scan() cut the dwell short. */
+
+  /* Inform with the access points of the BSS database. Report all of them
+   * when the scan flushes the BSS list or when the periodic refresh is due,
+   * only the changes otherwise. An aborted scan reports nothing, so the
+   * abort completes as fast as possible. */
+  if (!info.aborted) {
+    full = (navi->scan_request->flags & NL80211_SCAN_FLAG_FLUSH) ||
+           time_after_eq(jiffies, navi->bss_refresh_at);
+    if (full) {
+      navi->bss_refresh_at =
+          jiffies + msecs_to_jiffies(READ_ONCE(scan_full_refresh_ms));
+    }
+    inform_dummy_bss_table(navi, full);
+  }
+
+  /* Finish the scan by calling cfg80211_scan_done() with the scan request and
+   * info. It marks the scan as complete and provides information about the scan
+   * status. */
+  t.report_ns = ktime_get_ns();
+  cfg80211_scan_done(navi->scan_request, &info);
+  t.report_ns = ktime_get_ns() - t.report_ns;
+
+  // Reset the scan_request pointer to NULL
+  navi->scan_request = NULL;
+  nvf_op_done(navi, NVF_OP_SCAN, &t, info.aborted ? -ECANCELED : 0);
+
+  // Release the scan ownership, ordered after the request was reported.
+  atomic_fetch_andnot_release(DUMMY_WIFI_STATE_SCANNING, &navi->state);
+}
+
+/**
+ * @brief Check whether an access point matches a scheduled scan request.
+ *
+ * An access point matches when its signal reaches the minimum of the request
+ * and one of the match sets selects it by SSID and/or BSSID, at or above the
+ * RSSI threshold of the set. A request without match sets matches every
+ * access point. Per-band thresholds are not supported.
+ *
+ * @param req Scheduled scan request.
+ * @param bss Access point of the BSS database.
+ *
+ * @return true if the access point matches.
+ */
+static bool nvf_sched_scan_match(const struct cfg80211_sched_scan_request *req,
+                                 const struct dummy_wifi_bss *bss) {
+  const struct cfg80211_match_set *ms;
+  int i;
+
+  if (bss->signal < req->min_rssi_thold * 100) {
+    return false;
+  }
+  if (req->n_match_sets == 0) {
+    return true;
+  }
+
+  for (i = 0; i < req->n_match_sets; i++) {
+    ms = &req->match_sets[i];
+    if (ms->ssid.ssid_len &&
+        (ms->ssid.ssid_len != bss->ssid_len ||
+         memcmp(ms->ssid.ssid, bss->ssid, bss->ssid_len))) {
+      continue;
+    }
+    if (!is_zero_ether_addr(ms->bssid) &&
+        !ether_addr_equal(ms->bssid, bss->bssid)) {
+      continue;
+    }
+    if (bss->signal >= ms->rssi_thold * 100) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Scheduled scan routine, run once per interval of the scan plans.
+ *
+ * The access points of the BSS database on the requested channels are
+ * filtered against the match sets of the request. The matches are only
+ * informed, and cfg80211 only notified of results, when they differ from
+ * the previous iteration or when the periodic refresh is due, so an unchanged
+ * environment costs no netlink traffic. No dwell time is emulated, like a
+ * scan offloaded to the firmware.
+ *
+ * @param w A pointer to the work_struct embedded in ws_sched_scan.
+ */
+static void dummy_wifi_sched_scan_routine(struct work_struct *w) {
+  struct dummy_wifi_context *navi =
+      container_of(to_delayed_work(w), struct dummy_wifi_context,
+                   ws_sched_scan);
+  struct cfg80211_sched_scan_request *req = navi->sched_scan_request;
+  const struct cfg80211_sched_scan_plan *plan;
+  DECLARE_BITMAP(chans, ARRAY_SIZE(nvf_airs));
+  struct dummy_wifi_bss_table *table;
+  const struct dummy_wifi_bss *bss, *end;
+  u64 start = ktime_get_ns();
+  unsigned int matches = 0;
+  struct nvf_air *air;
+  bool changed;
+  u32 *gens;
+  int i;
+
+  bitmap_zero(chans, ARRAY_SIZE(nvf_airs));
+  for (i = 0; i < req->n_channels; i++) {
+    air = req->channels[i] != NULL ? nvf_channel_air(req->channels[i]) : NULL;
+    if (air != NULL) {
+      __set_bit(air - nvf_airs, chans);
+    }
+  }
+
+  /* List the generations of the matches. A generation identifies the content
+   * of one access point and the table is sorted by BSSID, so two lists are
+   * equal exactly when the matches are. */
+  table = dummy_wifi_bss_table_get(navi);
+  gens = kvmalloc_array(max(table->n_bss, 1U), sizeof(*gens), GFP_KERNEL);
+  end = table->bss + table->n_bss;
+  for (bss = table->bss; bss < end; bss++) {
+    if (nvf_sched_scan_match(req, bss) &&
+        test_bit(nvf_channel_air(bss->chan) - nvf_airs, chans)) {
+      if (gens != NULL) {
+        gens[matches] = bss->gen;
+      }
+      matches++;
+    }
+  }
+
+  // Without a list to compare, report as if the matches had changed.
+  changed = gens == NULL || matches != navi->sched_scan_n_gens ||
+            (matches && memcmp(gens, navi->sched_scan_gens,
+                               matches * sizeof(*gens)));
+
+  if (matches &&
+      (changed || time_after_eq(jiffies, navi->sched_scan_refresh_at))) {
+    for (bss = table->bss; bss < end; bss++) {
+      if (nvf_sched_scan_match(req, bss) &&
+          test_bit(nvf_channel_air(bss->chan) - nvf_airs, chans)) {
+        inform_dummy_bss(navi, table, bss);
+      }
+    }
+    cfg80211_sched_scan_results(navi->wiphy, req->reqid);
+    navi->sched_scan_refresh_at =
+        jiffies + msecs_to_jiffies(READ_ONCE(scan_full_refresh_ms));
+    WRITE_ONCE(navi->sched_scan_results, navi->sched_scan_results + 1);
+  }
+  kvfree(navi->sched_scan_gens);
+  navi->sched_scan_gens = gens;
+  navi->sched_scan_n_gens = gens != NULL ? matches : 0;
+  dummy_wifi_bss_table_put(table);
+
+  // Move on to the next plan once this one ran all its iterations; the last
+  // plan runs forever.
+  plan = &req->scan_plans[navi->sched_scan_plan];
+  if (plan->iterations && ++navi->sched_scan_iter >= plan->iterations &&
+      navi->sched_scan_plan + 1 < req->n_scan_plans) {
+    navi->sched_scan_plan++;
+    navi->sched_scan_iter = 0;
+    plan++;
+  }
+  queue_delayed_work(dummy_wifi_wq, &navi->ws_sched_scan,
+                     plan->interval * HZ);
+
+  WRITE_ONCE(navi->sched_scan_count, navi->sched_scan_count + 1);
+  WRITE_ONCE(navi->sched_scan_ns,
+             navi->sched_scan_ns + ktime_get_ns() - start);
+}
+
+/**
+ * @brief Connect routine for the DummyWiFi device.
+ * This function is responsible for handling the connection routine of the
+ * DummyWiFi device. It checks if the connecting SSID is a dummy SSID and takes
+ * appropriate actions.
+ *
+ * It just looks up the ESS to connect in the BSS database and informs the
+ * kernel that connect is finished. It should call cfg80211_connect_bss() when
+ * connect is finished or cfg80211_connect_timeout() when connect is failed.
+ * This "demo" can connect to any access point of the BSS database; the one
+ * with the strongest signal is used when several advertise the SSID. This
+ * routine called through workqueue, when the kernel asks about connect
+ * through cfg80211_ops.
+ *
+ * The outcome is published by moving the link state out of CONNECTING before
+ * reporting it. If a disconnect aborted the attempt in the meantime, the
+ * attempt is reported as failed, so cfg80211 always gets a connect result.
+ *
+ * @param w A pointer to the work_struct associated with the connection routine.
+ */
+static void dummy_wifi_connect_routine(struct work_struct *w) {
+  // Retrieve the DummyWiFi context from the work_struct.
+  struct dummy_wifi_context *navi =
+      container_of(w, struct dummy_wifi_context, ws_connect);
+  struct nvf_op_timing t = {};
+  struct dummy_wifi_bss_table *table;
+  const struct dummy_wifi_bss *bss;
+  int result = -ECANCELED;
+
+  nvf_op_start(navi, NVF_OP_CONNECT, &t);
+  mutex_lock(&navi->link_lock);
+  table = dummy_wifi_bss_table_get(navi);
+
+  // Look up the requested ESS (and BSSID, if any) in the BSS database.
+  bss = dummy_wifi_bss_find(table, navi->connecting_ssid,
+                            navi->connecting_ssid_len,
+                            is_zero_ether_addr(navi->connecting_bssid)
+                                ? NULL
+                                : navi->connecting_bssid);
+
+  // Check if the requested network is unknown.
+  if (bss == NULL) {
+    // The network is not in the database, trigger a connection timeout.
+    if (dummy_wifi_link_transition(navi, DUMMY_WIFI_LINK_CONNECTING,
+                                   DUMMY_WIFI_LINK_IDLE)) {
+      t.report_ns = ktime_get_ns();
+      cfg80211_connect_timeout(navi->ndev, NULL, NULL, 0, GFP_KERNEL,
+                               NL80211_TIMEOUT_SCAN);
+      t.report_ns = ktime_get_ns() - t.report_ns;
+      result = -ENOENT;
+      goto l_out;
+    }
+  } else {
+    // The network is known.
+
+    // Send its BSS information to the kernel.
+    inform_dummy_bss(navi, table, bss);
+
+    // The link runs at the best rate of the band, airtime pacing uses it.
+    WRITE_ONCE(navi->link_rate_kbps, nvf_channel_max_rate_kbps(bss->chan));
+
+    // Roaming starts from this access point.
+    ether_addr_copy(navi->connected_bssid, bss->bssid);
+
+    // Notify the kernel of a successful connection to a known ESS.
+    // It's also possible to use cfg80211_connect_result() or
+    // cfg80211_connect_done().
+    if (dummy_wifi_link_transition(navi, DUMMY_WIFI_LINK_CONNECTING,
+                                   DUMMY_WIFI_LINK_CONNECTED)) {
+      // From now on, transmit to the radios connected on the same channel.
+      if (READ_ONCE(medium)) {
+        dummy_wifi_air_attach(navi, bss->chan);
+      }
+      t.report_ns = ktime_get_ns();
+      cfg80211_connect_bss(navi->ndev, bss->bssid, NULL, NULL, 0, NULL, 0,
+                           WLAN_STATUS_SUCCESS, GFP_KERNEL,
+                           NL80211_TIMEOUT_UNSPECIFIED);
+      t.report_ns = ktime_get_ns() - t.report_ns;
+      result = 0;
+      goto l_out;
+    }
+  }
+
+  /* The attempt was aborted by nvf_disconnect(): undo the link setup and
+   * report the failure while still DISCONNECTING, so that it cannot be
+   * taken for the outcome of a newer attempt. */
+  WRITE_ONCE(navi->link_rate_kbps, 0);
+  eth_zero_addr(navi->connected_bssid);
+  t.report_ns = ktime_get_ns();
+  cfg80211_connect_result(navi->ndev, bss != NULL ? bss->bssid : NULL, NULL,
+                          0, NULL, 0, WLAN_STATUS_UNSPECIFIED_FAILURE,
+                          GFP_KERNEL);
+  t.report_ns = ktime_get_ns() - t.report_ns;
+  dummy_wifi_link_transition(navi, DUMMY_WIFI_LINK_DISCONNECTING,
+                             DUMMY_WIFI_LINK_IDLE);
+
+l_out:
+  dummy_wifi_bss_table_put(table);
+  mutex_unlock(&navi->link_lock);
+  nvf_op_done(navi, NVF_OP_CONNECT, &t, result);
+}
+
+/**
+ * @brief Disconnect routine for the DummyWiFi driver.
+ *
+ * This function is responsible for handling disconnection events in the
+ * DummyWiFi driver. It gets invoked as part of a work queue.
+ * This routine called through workqueue, when the kernel asks about
+ * disconnect through cfg80211_ops.
+ *
+ * It is only queued for a radio that reached CONNECTED, so it always reports
+ * the disconnection to cfg80211 before going back to IDLE.
+ *
+ * @param w Pointer to the work structure associated with the disconnection.
+ */
+static void dummy_wifi_disconnect_routine(struct work_struct *w) {
+
+  // Extract the DummyWiFi context structure from the work structure.
+  struct dummy_wifi_context *navi =
+      container_of(w, struct dummy_wifi_context, ws_disconnect);
+  struct nvf_op_timing t;
+
+  nvf_op_start(navi, NVF_OP_DISCONNECT, &t);
+
+  // The connect routine may still be reporting the connection it has just
+  // published; make sure "connected" reaches cfg80211 before "disconnected".
+  // Likewise, a roam in progress is reported first. Work items of the radio
+  // only wait for each other through link_lock, never with flush_work(): a
+  // work item queued behind this one may not get to run before it returns
+  // when the workqueue is short of workers (wq_max_active).
+  mutex_lock(&navi->link_lock);
+
+  // This function informs the wireless stack that the device has disconnected.
+  // Notify the wireless networking stack about the disconnection event.
+  // Parameters:
+  // - navi->ndev: The DummyWiFi network device.
   // - navi->disconnect_reason_code: The reason code for the disconnection.
   // - NULL: No IEs (Information Elements) to include in the disconnect frame.
   // - 0: Length of the IEs (0 because there are no IEs).
   // - true: Indicate that the disconnection is initiated by the local device.
   // - GFP_KERNEL: Memory allocation flags (Kernel memory allocation).
+  t.report_ns = ktime_get_ns();
   cfg80211_disconnected(navi->ndev, navi->disconnect_reason_code, NULL, 0, true,
                         GFP_KERNEL);
+  t.report_ns = ktime_get_ns() - t.report_ns;
+  WRITE_ONCE(navi->link_rate_kbps, 0);
+
+  // Leave the shared medium; it may be joined again on the next connection.
+  dummy_wifi_air_detach(navi);
+  synchronize_rcu();
+
+  // Reset the disconnect reason code to 0 to indicate a clean disconnection.
+  navi->disconnect_reason_code = 0;
+
+  // Back to idle, a new connection may be requested from now on.
+  nvf_op_done(navi, NVF_OP_DISCONNECT, &t, 0);
+  dummy_wifi_link_transition(navi, DUMMY_WIFI_LINK_DISCONNECTING,
+                             DUMMY_WIFI_LINK_IDLE);
+  mutex_unlock(&navi->link_lock);
+}
+
+/**
+ * @brief Roam routine for the DummyWiFi driver.
+ *
+ * Moves a connected radio to another access point of its ESS and reports it
+ * with cfg80211_roamed(). The link rate and, when the radio transmits on the
+ * shared medium, its channel follow the new access point. A change of the BSS
+ * database only runs the roaming policy; it is timed and traced from the
+ * moment the policy decides to roam. Requests from debugfs or the roam_all
+ * parameter are timed from the request and always completed, with -ENOENT
+ * when there is no access point to roam to and -ENOTCONN when the radio is
+ * not connected.
+ *
+ * @param w Pointer to the work structure associated with roaming.
+ */
+static void dummy_wifi_roam_routine(struct work_struct *w) {
+  struct dummy_wifi_context *navi =
+      container_of(w, struct dummy_wifi_context, ws_roam);
+  u64 req = atomic64_xchg(&navi->roam_request, 0);
+  struct cfg80211_roam_info info = {};
+  const struct dummy_wifi_bss *bss = NULL;
+  struct dummy_wifi_bss_table *table;
+  struct nvf_op_timing t = {};
+  int result = -ENOTCONN;
+
+  // The request was handled by the previous run.
+  if (req == 0) {
+    return;
+  }
+
+  // "Connected" must reach cfg80211 before "roamed", and "roamed" before
+  // "disconnected"; see dummy_wifi_disconnect_routine().
+  mutex_lock(&navi->link_lock);
+  table = dummy_wifi_bss_table_get(navi);
+  if ((atomic_read(&navi->state) & DUMMY_WIFI_LINK_MASK) ==
+      DUMMY_WIFI_LINK_CONNECTED) {
+    bss = dummy_wifi_roam_candidate(navi, table, req);
+    result = -ENOENT;
+  }
+
+  if (!(req & NVF_ROAM_REQUESTED)) {
+    if (bss == NULL) {
+      goto l_out;
+    }
+    nvf_op_request(navi, NVF_OP_ROAM);
+  }
+  nvf_op_start(navi, NVF_OP_ROAM, &t);
+  if (bss == NULL) {
+    goto l_done;
+  }
+
+  // Send the BSS information of the new access point to the kernel.
+  inform_dummy_bss(navi, table, bss);
+  WRITE_ONCE(navi->link_rate_kbps, nvf_channel_max_rate_kbps(bss->chan));
+
+  // Follow the access point to its channel on the shared medium.
+  if (navi->air != NULL && navi->air->chan != bss->chan) {
+    dummy_wifi_air_detach(navi);
+    synchronize_rcu();
+    dummy_wifi_air_attach(navi, bss->chan);
+  }
+  ether_addr_copy(navi->connected_bssid, bss->bssid);
+
+  info.links[0].bssid = bss->bssid;
+  info.links[0].channel = bss->chan;
+  t.report_ns = ktime_get_ns();
+  cfg80211_roamed(navi->ndev, &info, GFP_KERNEL);
+  t.report_ns = ktime_get_ns() - t.report_ns;
+  atomic_long_inc(&navi->roams);
+  result = 0;
+
+l_done:
+  nvf_op_done(navi, NVF_OP_ROAM, &t, result);
+l_out:
+  dummy_wifi_bss_table_put(table);
+  mutex_unlock(&navi->link_lock);
+}
+
+/**
+ * @brief Ask a radio to roam.
+ *
+ * A request still pending is replaced.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param req Roam request, see NVF_ROAM_POLICY.
+ */
+static void dummy_wifi_roam_request(struct dummy_wifi_context *navi, u64 req) {
+  nvf_op_request(navi, NVF_OP_ROAM);
+  atomic64_set(&navi->roam_request, req | NVF_ROAM_REQUESTED);
+  queue_work(dummy_wifi_wq, &navi->ws_roam);
+}
+
+/**
+ * @brief Parse a roam request.
+ *
+ * @param buf "next" to roam to the strongest other access point of the ESS,
+ *            "auto" to apply the roaming policy, or a BSSID to roam to.
+ * @param req Parsed request.
+ *
+ * @return 0 on success, -EINVAL if @p buf is malformed.
+ */
+static int dummy_wifi_roam_parse(const char *buf, u64 *req) {
+  char str[3 * ETH_ALEN + 1], *tok;
+  u8 bssid[ETH_ALEN];
+
+  if (sysfs_streq(buf, "next")) {
+    *req = NVF_ROAM_NEXT;
+    return 0;
+  }
+  if (sysfs_streq(buf, "auto")) {
+    *req = NVF_ROAM_POLICY;
+    return 0;
+  }
+
+  // A BSSID, possibly followed by a newline.
+  if (strscpy(str, buf, sizeof(str)) < 0) {
+    return -EINVAL;
+  }
+  tok = strim(str);
+  if (strlen(tok) != 3 * ETH_ALEN - 1 || !mac_pton(tok, bssid)) {
+    return -EINVAL;
+  }
+  *req = NVF_ROAM_TARGET | ether_addr_to_u64(bssid);
+
+  return 0;
+}
+
+/**
+ * @brief Ask a radio to roam through its "roam/trigger" debugfs file.
+ *
+ * @param file File opened for writing, its private data is the DummyWiFi
+ *             context.
+ * @param ubuf User buffer, see dummy_wifi_roam_parse().
+ * @param count Number of bytes to write.
+ * @param ppos Unused file position.
+ *
+ * @return @p count on success, a negative error code otherwise.
+ */
+static ssize_t dummy_wifi_roam_write(struct file *file,
+                                     const char __user *ubuf, size_t count,
+                                     loff_t *ppos) {
+  char buf[32];
+  u64 req;
+  int err;
+
+  if (count >= sizeof(buf)) {
+    return -EINVAL;
+  }
+  if (copy_from_user(buf, ubuf, count)) {
+    return -EFAULT;
+  }
+  buf[count] = '\0';
+
+  err = dummy_wifi_roam_parse(buf, &req);
+  if (err) {
+    return err;
+  }
+  dummy_wifi_roam_request(file->private_data, req);
+
+  return count;
+}
+
+static const struct file_operations dummy_wifi_roam_fops = {
+    .owner = THIS_MODULE,
+    .open = simple_open,
+    .write = dummy_wifi_roam_write,
+    .llseek = noop_llseek,
+};
+
+/**
+ * @brief Scan timer callback, called at the end of the dwell time on a
+ * channel.
+ *
+ * Moves to the next channel of the scan request and re-arms itself, so no
+ * worker thread sleeps while the scan is "in progress". After the last
+ * channel the scan routine is queued to report the results.
+ *
+ * @param timer Pointer to the scan timer embedded in the DummyWiFi context.
+ *
+ * @return HRTIMER_RESTART while channels are left, HRTIMER_NORESTART after
+ *         the last one.
+ */
+static enum hrtimer_restart dummy_wifi_scan_timer(struct hrtimer *timer) {
+  struct dummy_wifi_context *navi =
+      container_of(timer, struct dummy_wifi_context, scan_timer);
+
+  // Dwell on the next channel of the request, if any.
+  if (++navi->scan_channel < navi->scan_request->n_channels) {
+    hrtimer_forward_now(timer, navi->scan_dwell);
+    return HRTIMER_RESTART;
+  }
+
+  // All channels "scanned", report the results from process context.
+  nvf_op_queued(navi, NVF_OP_SCAN);
+  queue_work(dummy_wifi_wq, &navi->ws_scan);
+  return HRTIMER_NORESTART;
+}
+
+/**
+ * @brief Initiates a scan operation on a wireless device.
+ *
+ * This function is responsible for initiating a scan operation on a given
+ * wireless device. It takes ownership of the scan by atomically setting the
+ * scanning flag and schedules a work item to perform the scan. It never
+ * waits for a connect or disconnect in progress.
+ *
+ * @param wiphy The wireless PHY device for which the scan is to be initiated.
+ * @param request The scan request configuration.
+ * @return 0 on success, -EBUSY if another scan operation is already in
+ *         progress.
+ */
+static int nvf_scan(struct wiphy *wiphy,
+                    struct cfg80211_scan_request *request) {
+  // Obtain the DummyWiFi context associated with the wireless PHY device.
+  struct dummy_wifi_context *navi = wiphy_get_navi_context(wiphy)->navi;
+
+  // Check if there's already a scan request in progress; if so, return an
+  // error indicating that the device is busy.
+  if (atomic_fetch_or_acquire(DUMMY_WIFI_STATE_SCANNING, &navi->state) &
+      DUMMY_WIFI_STATE_SCANNING) {
+    nvf_op_busy(navi, NVF_OP_SCAN);
+    return -EBUSY;
+  }
+
+  // Set the scan request in the DummyWiFi context to the provided request.
+  nvf_op_request(navi, NVF_OP_SCAN);
+  navi->scan_request = request;
+  navi->scan_channel = 0;
+  navi->scan_dwell = us_to_ktime(READ_ONCE(navi->scan_dwell_us));
+
+  /* You can't call cfg80211_scan_done right away from cfg80211_ops->scan(),
+   * the netlink client may not receive the "scan done" message. The results
+   * are always reported from the workqueue, after the dwell time on every
+   * channel when it is configured. The scan work cannot be pending while we
+   * own the scanning flag, so queueing always succeeds. */
+  if (navi->scan_dwell == 0) {
+    queue_work(dummy_wifi_wq, &navi->ws_scan);
+  } else {
+    hrtimer_start(&navi->scan_timer, navi->scan_dwell, HRTIMER_MODE_REL_SOFT);
+  }
+
+  // Return 0 to indicate that the scan operation was successfully initiated.
+  return 0; /* OK */
+}
+
+/**
+ * @brief Cut the dwell of the scan in progress short.
+ *
+ * Shared by nvf_abort_scan() and dummy_wifi_scan_stop(); the radio must own
+ * the scanning flag. Nothing is done once the scan routine has started, it
+ * completes the scan normally.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ */
+static void dummy_wifi_scan_abort(struct dummy_wifi_context *navi) {
+  if (!nvf_op_abort(navi, NVF_OP_SCAN)) {
+    return;
+  }
+
+  /* Stop dwelling. hrtimer_cancel() waits for a running callback, which
+   * either queued the routine (after the last channel) or re-armed the timer
+   * (for the next one). A timer cancelled while armed queues nothing, so
+   * the routine is queued here, exactly once. */
+  if (hrtimer_cancel(&navi->scan_timer)) {
+    nvf_op_queued(navi, NVF_OP_SCAN);
+    queue_work(dummy_wifi_wq, &navi->ws_scan);
+  }
+}
+
+/**
+ * @brief Abort the scan in progress.
+ *
+ * The dwell on the remaining channels is cut short and the scan routine
+ * reports the scan as aborted right away; the latency from the abort to the
+ * report is recorded in the "abort" histogram of the scans. If the routine
+ * is already running, the scan completes normally and the abort is neither
+ * traced nor timed.
+ *
+ * @param wiphy The wireless PHY device.
+ * @param wdev The wireless device scanning.
+ */
+static void nvf_abort_scan(struct wiphy *wiphy, struct wireless_dev *wdev) {
+  struct dummy_wifi_context *navi = wiphy_get_navi_context(wiphy)->navi;
+
+  // cfg80211 serializes scan and abort_scan with the wiphy lock.
+  if (!(atomic_read_acquire(&navi->state) & DUMMY_WIFI_STATE_SCANNING)) {
+    return;
+  }
+  dummy_wifi_scan_abort(navi);
+}
+
+/**
+ * @brief Complete the scan in progress, if any, before the device goes down.
+ *
+ * cfg80211 expects the scan of a device to be reported when the device goes
+ * down, and frees the request then. The scan is aborted as by
+ * nvf_abort_scan(), and the scan routine is waited for, so neither the scan
+ * timer nor the routine use the request afterwards. Must not be called from
+ * the driver workqueue.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ */
+static void dummy_wifi_scan_stop(struct dummy_wifi_context *navi) {
+  if (!(atomic_read_acquire(&navi->state) & DUMMY_WIFI_STATE_SCANNING)) {
+    return;
+  }
+  dummy_wifi_scan_abort(navi);
+
+  // The routine reports the scan, as aborted unless it was already running.
+  flush_work(&navi->ws_scan);
+}
+
+/**
+ * @brief Connects a wireless device to a network.
+ *
+ * This function connects a wireless device to a network using the provided
+ * parameters. The radio must be idle; the connect work item owns the
+ * CONNECTING state until it reports the outcome.
+ *
+ * @param wiphy The wireless PHY (physical layer) structure.
+ * @param dev The network device structure.
+ * @param sme The connection parameters including SSID.
+ *
+ * @return 0 on success, or -EBUSY if a connection or disconnection is still
+ *         in progress.
+ */
+static int nvf_connect(struct wiphy *wiphy, struct net_device *dev,
+                       struct cfg80211_connect_params *sme) {
+  // Get the DummyWiFi context associated with the wireless PHY.
+  struct dummy_wifi_context *navi = wiphy_get_navi_context(wiphy)->navi;
+
+  // Claim the link, only an idle radio can start connecting.
+  if (!dummy_wifi_link_transition(navi, DUMMY_WIFI_LINK_IDLE,
+                                  DUMMY_WIFI_LINK_CONNECTING)) {
+    nvf_op_busy(navi, NVF_OP_CONNECT);
+    return -EBUSY;
+  }
+  nvf_op_request(navi, NVF_OP_CONNECT);
+
+  // Copy the SSID (validated by cfg80211) and the optional BSSID from the
+  // connection parameters to the DummyWiFi context.
+  memcpy(navi->connecting_ssid, sme->ssid, sme->ssid_len);
+  navi->connecting_ssid_len = sme->ssid_len;
+  if (sme->bssid != NULL) {
+    ether_addr_copy(navi->connecting_bssid, sme->bssid);
+  } else {
+    eth_zero_addr(navi->connecting_bssid);
+  }
+
+  // Schedule the connection work to be performed asynchronously. It cannot
+  // be pending while the radio was idle, so this always succeeds.
+  queue_work(dummy_wifi_wq, &navi->ws_connect);
+
+  // The connection request was successfully initiated.
+  return 0;
+}
+
+/**
+ * @brief Disconnect a wireless device from a Wi-Fi network.
+ *
+ * This function is used to disconnect a wireless device from a Wi-Fi network
+ * by providing a reason code for the disconnection. A connected radio
+ * schedules the disconnect work; a radio still connecting only marks the
+ * attempt as aborted, and the connect work reports it to cfg80211 as failed.
+ *
+ * @param wiphy Pointer to the wireless hardware (WiPHY) structure.
+ * @param dev Pointer to the network device structure.
+ * @param reason_code The reason code for the disconnection.
+ * @return Always 0.
+ */
+static int nvf_disconnect(struct wiphy *wiphy, struct net_device *dev,
+                          u16 reason_code) {
+  // Retrieve the DummyWiFi context associated with the provided wiphy
+  // structure.
+  struct dummy_wifi_context *navi = wiphy_get_navi_context(wiphy)->navi;
+
+  // Abort a connection attempt that has not been reported yet.
+  if (dummy_wifi_link_transition(navi, DUMMY_WIFI_LINK_CONNECTING,
+                                 DUMMY_WIFI_LINK_DISCONNECTING)) {
+    return 0;
+  }
+
+  // Claim the link, nothing to do when the radio is not connected.
+  if (!dummy_wifi_link_transition(navi, DUMMY_WIFI_LINK_CONNECTED,
+                                  DUMMY_WIFI_LINK_DISCONNECTING)) {
+    return 0;
+  }
+
+  // Set the disconnect reason code in the DummyWiFi context.
+  nvf_op_request(navi, NVF_OP_DISCONNECT);
+  navi->disconnect_reason_code = reason_code;
+
+  // Schedule the disconnection work to be executed asynchronously.
+  queue_work(dummy_wifi_wq, &navi->ws_disconnect);
+  return 0; // Return success status.
+}
+
+/**
+ * @brief Start a scheduled scan.
+ *
+ * The first iteration runs after the delay of the request, the next ones at
+ * the intervals of its scan plans until nvf_sched_scan_stop().
+ *
+ * @param wiphy The wireless PHY device.
+ * @param dev The network device.
+ * @param request The scheduled scan request, valid until it is stopped.
+ *
+ * @return 0 on success, -EBUSY if a scheduled scan is already running.
+ */
+static int nvf_sched_scan_start(struct wiphy *wiphy, struct net_device *dev,
+                                struct cfg80211_sched_scan_request *request) {
+  struct dummy_wifi_context *navi = wiphy_get_navi_context(wiphy)->navi;
+
+  // cfg80211 serializes start and stop with the wiphy lock.
+  if (navi->sched_scan_request != NULL) {
+    return -EBUSY;
+  }
+
+  navi->sched_scan_request = request;
+  navi->sched_scan_plan = 0;
+  navi->sched_scan_iter = 0;
+  navi->sched_scan_n_gens = 0;
+  navi->sched_scan_refresh_at = jiffies;
+  queue_delayed_work(dummy_wifi_wq, &navi->ws_sched_scan,
+                     request->delay * HZ);
+
+  return 0;
+}
+
+/**
+ * @brief Stop a scheduled scan.
+ *
+ * Waits for a running iteration, cfg80211 frees the request on return. The
+ * routine never takes the wiphy lock, so this cannot deadlock.
+ *
+ * @param wiphy The wireless PHY device.
+ * @param dev The network device.
+ * @param reqid Identifier of the request to stop.
+ *
+ * @return 0 on success, -ENOENT if no such scheduled scan is running.
+ */
+static int nvf_sched_scan_stop(struct wiphy *wiphy, struct net_device *dev,
+                               u64 reqid) {
+  struct dummy_wifi_context *navi = wiphy_get_navi_context(wiphy)->navi;
+
+  if (navi->sched_scan_request == NULL ||
+      navi->sched_scan_request->reqid != reqid) {
+    return -ENOENT;
+  }
+
+  cancel_delayed_work_sync(&navi->ws_sched_scan);
+  navi->sched_scan_request = NULL;
+  kvfree(navi->sched_scan_gens);
+  navi->sched_scan_gens = NULL;
+  navi->sched_scan_n_gens = 0;
+
+  return 0;
+}
+
+/**
+ * @brief Structure for storing operations related to the cfg80211 subsystem.
+ *
+ * This structure defines a set of operations that can be performed on the
+ * cfg80211 subsystem. These operations are typically implemented by a driver
+ * or a module to interact with the wireless networking stack.
+ *
+ * Structure of functions for FullMAC 80211 drivers.
+ * Functions that implemented along with fields/flags in wiphy structure would
+ * represent drivers features. This DEMO can perform "scan" (which can be
+ * aborted), scheduled scans, "connect" and "disconnect"; roaming is decided
+ * by the driver and needs no operation. Some functions cant be implemented
+ * alone, for example: with "connect" there is should be function "disconnect"
+ * and with "sched_scan_start" there is "sched_scan_stop".
+ */
+static struct cfg80211_ops nvf_cfg_ops = {
+    /**
+     * @brief Function pointer to the scan operation.
+     *
+     * This function is called when the cfg80211 subsystem needs to perform a
+     * Wi-Fi network scan. It should be implemented to initiate and handle the
+     * scanning process.
+     */
+    .scan = nvf_scan,
+
+    /**
+     * @brief Function pointer to the abort scan operation.
+     *
+     * This function is called when the cfg80211 subsystem wants the scan in
+     * progress to stop early, e.g. before connecting.
+     */
+    .abort_scan = nvf_abort_scan,
+
+    /**
+     * @brief Function pointer to the connect operation.
+     *
+     * This function is called when the cfg80211 subsystem needs to establish
+     * a connection to a Wi-Fi network. It should be implemented to handle the
+     * connection setup and management.
+     */
+    .connect = nvf_connect,
+
+    /**
+     * @brief Function pointer to the disconnect operation.
+     *
+     * This function is called when the cfg80211 subsystem needs to disconnect
+     * from a currently connected Wi-Fi network. It should be implemented to
+     * perform the necessary cleanup and disconnection steps.
+     */
+    .disconnect = nvf_disconnect,
+
+    /**
+     * @brief Function pointers to the scheduled scan operations.
+     *
+     * These functions are called when the cfg80211 subsystem offloads
+     * periodic scans to the driver, e.g. for wpa_supplicant background scans.
+     * Results are only reported when access points match the request.
+     */
+    .sched_scan_start = nvf_sched_scan_start,
+    .sched_scan_stop = nvf_sched_scan_stop,
+};
+
+/**
+ * @brief Prepare a frame for reception by a radio.
+ *
+ * The frame is scrubbed as if it was received by @p peer. It is consumed on
+ * failure. Must be called within an RCU read-side critical section, with
+ * bottom halves disabled.
+ *
+ * @param peer Pointer to the DummyWiFi context of the receiving radio.
+ * @param skb Frame to prepare.
+ *
+ * @return true if the frame can be queued, false if it was dropped.
+ */
+static bool nvf_rx_prepare(struct dummy_wifi_context *peer,
+                           struct sk_buff *skb) {
+  // Frames can only be delivered while the peer interface is up.
+  if (unlikely(!netif_running(peer->ndev))) {
+    goto l_drop;
+  }
+
+  /* A peer with receive checksum offload turned off must not see partial
+   * checksums, complete them here. */
+  if (unlikely(skb->ip_summed == CHECKSUM_PARTIAL &&
+               !(peer->ndev->features & NETIF_F_RXCSUM)) &&
+      skb_checksum_help(skb)) {
+    goto l_drop;
+  }
+
+  /* Scrub the frame and set its protocol as if it was received by the peer.
+   * GSO frames are accepted whatever their length and travel in one piece.
+   * On failure the skb is already freed and accounted by the peer. */
+  return __dev_forward_skb(peer->ndev, skb) == NET_RX_SUCCESS;
+
+l_drop:
+  kfree_skb(skb);
+  return false;
+}
+
+/**
+ * @brief Queue a frame on a receive queue of a radio.
+ *
+ * The frame is scrubbed as if it was received by @p peer, queued on its
+ * receive queue @p qid and the NAPI of the queue is scheduled to deliver it.
+ * The frame is consumed in any case. Must be called within an RCU read-side
+ * critical section, with bottom halves disabled.
+ *
+ * @param peer Pointer to the DummyWiFi context of the receiving radio.
+ * @param skb Frame to deliver.
+ * @param qid Transmit queue of the frame.
+ *
+ * @return true if the frame was queued, false if it was dropped.
+ */
+static bool nvf_deliver_skb(struct dummy_wifi_context *peer,
+                            struct sk_buff *skb, u16 qid) {
+  struct dummy_wifi_rq *rq;
+
+  if (!nvf_rx_prepare(peer, skb)) {
+    return false;
+  }
+
+  // The peer may have been created with fewer queues (CPU hotplug).
+  if (unlikely(qid >= peer->n_queues)) {
+    qid %= peer->n_queues;
+  }
+  rq = &peer->rq[qid];
+  skb_record_rx_queue(skb, qid);
+
+  // Queue the frame for the peer and kick its NAPI poll loop.
+  if (unlikely(ptr_ring_produce(&rq->ring, skb))) {
+    kfree_skb(skb);
+    return false;
+  }
+  napi_schedule(&rq->napi);
+
+  return true;
+}
+
+/**
+ * @brief Queue a frame heard on a shared medium on a radio.
+ *
+ * Each station has one medium ring per CPU, filled only by the CPU it
+ * belongs to with bottom halves disabled, and drained only by the NAPI of
+ * the receive queue the CPU maps to (see nvf_air_rx()). Either side thus has
+ * a single user and the ring is used without its locks, however many
+ * stations transmit on the medium. The frame is consumed in any case. Must
+ * be called within an RCU read-side critical section, with bottom halves
+ * disabled.
+ *
+ * @param sta Pointer to the DummyWiFi context of the receiving radio.
+ * @param skb Frame to deliver.
+ *
+ * @return true if the frame was queued, false if it was dropped.
+ */
+static bool nvf_air_produce(struct dummy_wifi_context *sta,
+                            struct sk_buff *skb) {
+  unsigned int cpu = smp_processor_id();
+  u16 qid = cpu % sta->n_queues;
+
+  if (!nvf_rx_prepare(sta, skb)) {
+    return false;
+  }
+  skb_record_rx_queue(skb, qid);
+
+  // Rings are allocated before the station shows up on the medium.
+  if (unlikely(__ptr_ring_produce(this_cpu_ptr(sta->air_rings), skb))) {
+    kfree_skb(skb);
+    return false;
+  }
+  napi_schedule(&sta->rq[qid].napi);
+
+  return true;
+}
+
+/**
+ * @brief Deliver a frame heard on a shared medium to a radio.
+ *
+ * XDP programs see a frame as a single page, so nvf_rcv_skb() drops GSO
+ * frames on a radio running one. The peer of such a radio stops sending
+ * them (see nvf_ndo_fix_features()), but any station of a medium may send
+ * to it, so GSO frames are segmented here instead. Must be called within an
+ * RCU read-side critical section, with bottom halves disabled.
+ *
+ * @param sta Pointer to the DummyWiFi context of the receiving radio.
+ * @param skb Frame to deliver, consumed in any case.
+ *
+ * @return true if the frame, or one of its segments, was queued.
+ */
+static bool nvf_air_deliver(struct dummy_wifi_context *sta,
+                            struct sk_buff *skb) {
+  struct sk_buff *segs, *next;
+  bool sent = false;
+
+  if (likely(!skb_is_gso(skb) || rcu_access_pointer(sta->xdp_prog) == NULL)) {
+    return nvf_air_produce(sta, skb);
+  }
+
+  segs = skb_gso_segment(skb, 0);
+  if (IS_ERR_OR_NULL(segs)) {
+    kfree_skb(skb);
+    return false;
+  }
+  consume_skb(skb);
+
+  skb_list_walk_safe(segs, skb, next) {
+    skb_mark_not_on_list(skb);
+    sent |= nvf_air_produce(sta, skb);
+  }
+
+  return sent;
+}
+
+/**
+ * @brief Transmit a frame on a shared medium.
+ *
+ * Every other radio attached to the medium hears the frame: group addressed
+ * frames are delivered to all of them, each getting a clone, and unicast
+ * frames to the radio with the destination address only. A frame nobody
+ * receives was still transmitted. Must be called within an RCU read-side
+ * critical section, with bottom halves disabled.
+ *
+ * Receivers get the frame on their medium ring of the current CPU, see
+ * nvf_air_produce(), so radios on a channel share no lock on the data path.
+ *
+ * @param navi Pointer to the DummyWiFi context of the sending radio.
+ * @param air Medium of the sending radio.
+ * @param skb Frame to transmit.
+ *
+ * @return false if the frame was dropped before any radio got it.
+ */
+static bool nvf_air_xmit(struct dummy_wifi_context *navi, struct nvf_air *air,
+                         struct sk_buff *skb) {
+  const struct ethhdr *eth = (const struct ethhdr *)skb->data;
+  bool group = is_multicast_ether_addr(eth->h_dest);
+  struct dummy_wifi_context *sta, *last = NULL;
+  struct sk_buff *clone;
+
+  atomic_long_inc(&air->frames);
+  list_for_each_entry_rcu(sta, &air->stations, air_node) {
+    if (sta == navi ||
+        (!group && !ether_addr_equal(eth->h_dest, sta->ndev->dev_addr))) {
+      continue;
+    }
+    // Clone for all receivers but the last, which gets the frame itself.
+    if (last != NULL) {
+      clone = skb_clone(skb, GFP_ATOMIC);
+      if (clone != NULL) {
+        nvf_air_deliver(last, clone);
+      }
+    }
+    last = sta;
+  }
+
+  if (last == NULL) {
+    consume_skb(skb);
+    return true;
+  }
+
+  return nvf_air_deliver(last, skb);
+}
+
+/**
+ * @brief Forward a frame to the peer of a radio.
+ *
+ * The frame is forwarded veth-style to the receive queue of the peer device
+ * (the device itself when no peer is set, which gives a loopback link) and
+ * the peer's NAPI is scheduled to deliver it. Transmit queue N feeds receive
+ * queue N of the peer, so the data path shares no state between queues. A
+ * radio attached to a shared medium transmits on the medium instead, see
+ * nvf_air_xmit(). The frame is consumed in any case, and accounted in the
+ * statistics of the radio. Must be called with bottom halves disabled.
+ *
+ * @param navi Pointer to the DummyWiFi context of the sending radio.
+ * @param skb Frame to forward.
+ * @param qid Transmit queue of the frame.
+ */
+static void nvf_xmit_skb(struct dummy_wifi_context *navi, struct sk_buff *skb,
+                         u16 qid) {
+  struct dummy_wifi_stats *stats = this_cpu_ptr(navi->stats);
+  struct dummy_wifi_context *peer = NULL;
+  unsigned int len = skb->len;
+  struct nvf_air *air;
+  bool sent;
+
+  rcu_read_lock();
+  air = READ_ONCE(navi->air);
+  if (air != NULL) {
+    sent = nvf_air_xmit(navi, air, skb);
+  } else {
+    peer = rcu_dereference(navi->peer);
+    if (likely(peer != NULL)) {
+      sent = nvf_deliver_skb(peer, skb, qid);
+    } else {
+      kfree_skb(skb);
+      sent = false;
+    }
+  }
+  rcu_read_unlock();
+
+  u64_stats_update_begin(&stats->syncp);
+  if (likely(sent)) {
+    u64_stats_inc(&stats->tx_packets);
+    u64_stats_add(&stats->tx_bytes, len);
+  } else {
+    u64_stats_inc(&stats->tx_dropped);
+  }
+  u64_stats_update_end(&stats->syncp);
+}
+
+/**
+ * @brief Check whether a receive ring entry is an XDP frame.
+ *
+ * Receive rings carry socket buffers sent by the peer's ndo_start_xmit() and
+ * XDP frames sent by its ndo_xdp_xmit() (or XDP_TX). XDP frames are tagged in
+ * the lowest bit of the pointer, which is always clear for both.
+ *
+ * @param ptr Entry of the ring.
+ *
+ * @return true for an XDP frame, false for a socket buffer.
+ */
+static bool nvf_is_xdp_frame(void *ptr) {
+  return (unsigned long)ptr & NVF_XDP_FLAG;
+}
+
+/**
+ * @brief Tag an XDP frame for a receive ring.
+ *
+ * @param frame XDP frame.
+ *
+ * @return Entry of the ring.
+ */
+static void *nvf_xdp_to_ptr(struct xdp_frame *frame) {
+  return (void *)((unsigned long)frame | NVF_XDP_FLAG);
+}
+
+/**
+ * @brief Untag an XDP frame taken from a receive ring.
+ *
+ * @param ptr Entry of the ring, see nvf_is_xdp_frame().
+ *
+ * @return XDP frame.
+ */
+static struct xdp_frame *nvf_ptr_to_xdp(void *ptr) {
+  return (void *)((unsigned long)ptr & ~NVF_XDP_FLAG);
+}
+
+/**
+ * @brief Free a frame left on a receive ring.
+ *
+ * Destructor passed to ptr_ring_cleanup() so that frames still queued when a
+ * device goes away are released.
+ *
+ * @param ptr Entry of the ring, a socket buffer or a tagged XDP frame.
+ */
+static void nvf_ring_free(void *ptr) {
+  if (nvf_is_xdp_frame(ptr)) {
+    xdp_return_frame(nvf_ptr_to_xdp(ptr));
+  } else {
+    kfree_skb(ptr);
+  }
+}
+
+/**
+ * @brief Queue XDP frames on a receive ring of the peer of a radio.
+ *
+ * Shared by ndo_xdp_xmit() and XDP_TX. The frames go to the receive queue of
+ * the peer matching the current CPU, under a single acquisition of the ring's
+ * producer lock. Must be called with bottom halves disabled.
+ *
+ * @param navi Pointer to the DummyWiFi context of the sending radio.
+ * @param frames XDP frames to send.
+ * @param n Number of frames.
+ *
+ * @return Number of frames queued, the caller keeps the others.
+ */
+static int nvf_xdp_xmit_frames(struct dummy_wifi_context *navi,
+                               struct xdp_frame **frames, int n) {
+  struct dummy_wifi_stats *stats = this_cpu_ptr(navi->stats);
+  struct dummy_wifi_context *peer;
+  struct dummy_wifi_rq *rq;
+  u64 bytes = 0;
+  int sent = 0;
+
+  rcu_read_lock();
+
+  // Frames can only be delivered while the peer interface is up.
+  peer = rcu_dereference(navi->peer);
+  if (unlikely(peer == NULL || !netif_running(peer->ndev))) {
+    goto l_out;
+  }
+
+  rq = &peer->rq[smp_processor_id() % peer->n_queues];
+  spin_lock(&rq->ring.producer_lock);
+  for (; sent < n; sent++) {
+    if (__ptr_ring_produce(&rq->ring, nvf_xdp_to_ptr(frames[sent]))) {
+      break;
+    }
+    bytes += frames[sent]->len;
+  }
+  spin_unlock(&rq->ring.producer_lock);
+
+  if (sent) {
+    napi_schedule(&rq->napi);
+  }
+
+l_out:
+  rcu_read_unlock();
+
+  u64_stats_update_begin(&stats->syncp);
+  u64_stats_add(&stats->tx_packets, sent);
+  u64_stats_add(&stats->tx_bytes, bytes);
+  u64_stats_add(&stats->tx_dropped, n - sent);
+  u64_stats_update_end(&stats->syncp);
+
+  return sent;
+}
+
+/**
+ * @brief Send the XDP_TX frames of a NAPI poll to the peer.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param rb State of the NAPI poll.
+ */
+static void nvf_xdp_tx_flush(struct dummy_wifi_context *navi,
+                             struct nvf_rx_batch *rb) {
+  int sent = nvf_xdp_xmit_frames(navi, rb->xdp_tx, rb->n_xdp_tx);
+
+  while (sent < rb->n_xdp_tx) {
+    xdp_return_frame_rx_napi(rb->xdp_tx[sent++]);
+  }
+  rb->n_xdp_tx = 0;
+}
+
+/**
+ * @brief Queue an XDP_TX frame, sending the batch when it is full.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param rb State of the NAPI poll.
+ * @param frame Frame to send back to the peer.
+ */
+static void nvf_xdp_tx(struct dummy_wifi_context *navi,
+                       struct nvf_rx_batch *rb, struct xdp_frame *frame) {
+  rb->xdp_tx[rb->n_xdp_tx++] = frame;
+  if (rb->n_xdp_tx == NVF_XDP_TX_BULK) {
+    nvf_xdp_tx_flush(navi, rb);
+  }
+}
+
+/**
+ * @brief Get a receive buffer for a frame of a queue.
+ *
+ * With an AF_XDP socket bound to the queue (and the XDP program that feeds
+ * it), the buffer comes from the fill ring of the socket, so the program can
+ * redirect the frame without a copy; otherwise it is a page of the page pool
+ * of the queue.
+ *
+ * @param rq Receive queue.
+ * @param rb State of the NAPI poll.
+ * @param buf Storage for the descriptor of a page pool buffer.
+ * @param len Length of the frame.
+ *
+ * @return The buffer, @p len bytes long and ready to be written at data, or
+ *         NULL if there is none or the frame does not fit.
+ */
+static struct xdp_buff *nvf_rq_alloc_buff(struct dummy_wifi_rq *rq,
+                                          struct nvf_rx_batch *rb,
+                                          struct xdp_buff *buf,
+                                          unsigned int len) {
+  struct xdp_buff *xdp;
+  struct page *page;
+
+  if (rb->xsk_pool != NULL) {
+    if (len > xsk_pool_get_rx_frame_size(rb->xsk_pool)) {
+      return NULL;
+    }
+    xdp = xsk_buff_alloc(rb->xsk_pool);
+    if (xdp != NULL) {
+      xdp->data_end = xdp->data + len;
+    }
+    return xdp;
+  }
+
+  if (XDP_PACKET_HEADROOM + SKB_DATA_ALIGN(len) +
+          SKB_DATA_ALIGN(sizeof(struct skb_shared_info)) >
+      PAGE_SIZE) {
+    return NULL;
+  }
+  page = page_pool_dev_alloc_pages(rq->page_pool);
+  if (unlikely(page == NULL)) {
+    return NULL;
+  }
+
+  xdp_init_buff(buf, PAGE_SIZE, &rq->xdp_rxq);
+  xdp_prepare_buff(buf, page_address(page), XDP_PACKET_HEADROOM, len, true);
+  return buf;
+}
+
+/**
+ * @brief Give back a receive buffer that was not used.
+ *
+ * @param rq Receive queue owning the buffer.
+ * @param xdp Buffer from nvf_rq_alloc_buff().
+ */
+static void nvf_rq_free_buff(struct dummy_wifi_rq *rq, struct xdp_buff *xdp) {
+  if (xdp->rxq->mem.type == MEM_TYPE_XSK_BUFF_POOL) {
+    xsk_buff_free(xdp);
+  } else {
+    page_pool_recycle_direct(rq->page_pool, virt_to_head_page(xdp->data));
+  }
+}
+
+/**
+ * @brief Copy a frame out of an AF_XDP buffer for the stack.
+ *
+ * Buffers of the socket cannot be given to the stack, a frame the XDP program
+ * passes is copied. The buffer goes back to the fill ring in any case.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param rq Receive queue of the frame.
+ * @param xdp AF_XDP buffer.
+ *
+ * @return The frame, or NULL on allocation failure.
+ */
+static struct sk_buff *nvf_xsk_build_skb(struct dummy_wifi_context *navi,
+                                         struct dummy_wifi_rq *rq,
+                                         struct xdp_buff *xdp) {
+  unsigned int metalen = xdp->data - xdp->data_meta;
+  unsigned int len = xdp->data_end - xdp->data_meta;
+  struct sk_buff *skb;
+
+  skb = napi_alloc_skb(&rq->napi, len);
+  if (likely(skb != NULL)) {
+    skb_put_data(skb, xdp->data_meta, len);
+    if (metalen) {
+      __skb_pull(skb, metalen);
+      skb_metadata_set(skb, metalen);
+    }
+    skb->protocol = eth_type_trans(skb, navi->ndev);
+    skb_record_rx_queue(skb, rq - navi->rq);
+  }
+  xsk_buff_free(xdp);
+
+  return skb;
+}
+
+/**
+ * @brief Build a frame for the stack around a receive buffer.
+ *
+ * The buffer is a page of the page pool of the queue, recycled straight into
+ * the pool's lockless cache when the stack frees the frame in NAPI context.
+ * The buffer is released on failure.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param rq Receive queue owning the buffer.
+ * @param xdp Buffer, laid out as for an XDP program.
+ *
+ * @return The frame, or NULL on allocation failure.
+ */
+static struct sk_buff *nvf_xdp_build_skb(struct dummy_wifi_context *navi,
+                                         struct dummy_wifi_rq *rq,
+                                         struct xdp_buff *xdp) {
+  unsigned int metalen = xdp->data - xdp->data_meta;
+  struct sk_buff *skb;
+
+  skb = napi_build_skb(xdp->data_hard_start, xdp->frame_sz);
+  if (unlikely(skb == NULL)) {
+    page_pool_recycle_direct(rq->page_pool, virt_to_head_page(xdp->data));
+    return NULL;
+  }
+
+  skb_reserve(skb, xdp->data - xdp->data_hard_start);
+  __skb_put(skb, xdp->data_end - xdp->data);
+  if (metalen) {
+    skb_metadata_set(skb, metalen);
+  }
+  skb_mark_for_recycle(skb);
+
+  skb->protocol = eth_type_trans(skb, navi->ndev);
+  skb_record_rx_queue(skb, rq - navi->rq);
+
+  return skb;
+}
+
+/**
+ * @brief Run the XDP program on a receive buffer of a queue.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param rq Receive queue owning the buffer.
+ * @param xdp Buffer from nvf_rq_alloc_buff().
+ * @param rb State of the NAPI poll, rb->prog must be set.
+ *
+ * @return The frame for the stack on XDP_PASS, NULL otherwise (the buffer
+ *         was sent, redirected or dropped).
+ */
+static struct sk_buff *nvf_xdp_run(struct dummy_wifi_context *navi,
+                                   struct dummy_wifi_rq *rq,
+                                   struct xdp_buff *xdp,
+                                   struct nvf_rx_batch *rb) {
+  struct xdp_frame *frame;
+  u32 act = bpf_prog_run_xdp(rb->prog, xdp);
+
+  switch (act) {
+  case XDP_PASS:
+    if (xdp->rxq->mem.type == MEM_TYPE_XSK_BUFF_POOL) {
+      return nvf_xsk_build_skb(navi, rq, xdp);
+    }
+    return nvf_xdp_build_skb(navi, rq, xdp);
+  case XDP_TX:
+    // AF_XDP buffers are copied into a new frame and freed.
+    frame = xdp_convert_buff_to_frame(xdp);
+    if (unlikely(frame == NULL)) {
+      goto l_drop;
+    }
+    nvf_xdp_tx(navi, rb, frame);
+    return NULL;
+  case XDP_REDIRECT:
+    if (xdp_do_redirect(navi->ndev, xdp, rb->prog)) {
+      goto l_drop;
+    }
+    rb->xdp_redirect = true;
+    return NULL;
+  default:
+    bpf_warn_invalid_xdp_action(navi->ndev, rb->prog, act);
+    fallthrough;
+  case XDP_ABORTED:
+    trace_xdp_exception(navi->ndev, rb->prog, act);
+    fallthrough;
+  case XDP_DROP:
+    goto l_drop;
+  }
+
+l_drop:
+  nvf_rq_free_buff(rq, xdp);
+  rb->dropped++;
+  return NULL;
+}
+
+/**
+ * @brief Receive an XDP frame sent by the peer.
+ *
+ * The XDP program runs on the frame where it is. The frame may belong to any
+ * device (it was redirected to the peer), so the receive queue borrows its
+ * memory model while the program runs, and a returned frame goes back to
+ * its owner.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param rq Receive queue the frame was taken from.
+ * @param frame XDP frame.
+ * @param rb State of the NAPI poll.
+ *
+ * @return The frame for the stack, or NULL if it was consumed.
+ */
+static struct sk_buff *nvf_rcv_xdp_frame(struct dummy_wifi_context *navi,
+                                         struct dummy_wifi_rq *rq,
+                                         struct xdp_frame *frame,
+                                         struct nvf_rx_batch *rb) {
+  struct xdp_frame *tx_frame;
+  struct xdp_mem_info mem;
+  struct xdp_buff xdp;
+  struct sk_buff *skb;
+  u32 act;
+
+  if (rb->prog != NULL) {
+    xdp_convert_frame_to_buff(frame, &xdp);
+    xdp.rxq = &rq->xdp_rxq;
+    mem = rq->xdp_rxq.mem;
+    rq->xdp_rxq.mem = frame->mem;
+
+    act = bpf_prog_run_xdp(rb->prog, &xdp);
+    switch (act) {
+    case XDP_PASS:
+      if (xdp_update_frame_from_buff(&xdp, frame)) {
+        goto l_drop;
+      }
+      break;
+    case XDP_TX:
+      tx_frame = xdp_convert_buff_to_frame(&xdp);
+      if (unlikely(tx_frame == NULL)) {
+        goto l_drop;
+      }
+      nvf_xdp_tx(navi, rb, tx_frame);
+      goto l_consumed;
+    case XDP_REDIRECT:
+      if (xdp_do_redirect(navi->ndev, &xdp, rb->prog)) {
+        goto l_drop;
+      }
+      rb->xdp_redirect = true;
+      goto l_consumed;
+    default:
+      bpf_warn_invalid_xdp_action(navi->ndev, rb->prog, act);
+      fallthrough;
+    case XDP_ABORTED:
+      trace_xdp_exception(navi->ndev, rb->prog, act);
+      fallthrough;
+    case XDP_DROP:
+      goto l_drop;
+    }
+
+    rq->xdp_rxq.mem = mem;
+  }
+
+  skb = xdp_build_skb_from_frame(frame, navi->ndev);
+  if (unlikely(skb == NULL)) {
+    xdp_return_frame_rx_napi(frame);
+    rb->dropped++;
+    return NULL;
+  }
+  skb_record_rx_queue(skb, rq - navi->rq);
+
+  return skb;
+
+l_drop:
+  xdp_return_frame_rx_napi(frame);
+  rb->dropped++;
+l_consumed:
+  rq->xdp_rxq.mem = mem;
+  return NULL;
+}
+
+/**
+ * @brief Receive a socket buffer sent by the peer.
+ *
+ * Without an XDP program the frame goes to the stack as is. Otherwise it is
+ * copied into a receive buffer of the queue (a page of the page pool or a
+ * buffer of the bound AF_XDP socket), with the headroom XDP programs expect,
+ * and the program runs on the copy; this is the only copy on the path, the
+ * frames the driver builds are born in such buffers. GSO
+ * frames cannot be given to a program; the peer stops sending them while a
+ * program is attached, see nvf_ndo_fix_features().
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param rq Receive queue the frame was taken from.
+ * @param skb Socket buffer, already classified by eth_type_trans().
+ * @param rb State of the NAPI poll.
+ *
+ * @return The frame for the stack, or NULL if it was consumed.
+ */
+static struct sk_buff *nvf_rcv_skb(struct dummy_wifi_context *navi,
+                                   struct dummy_wifi_rq *rq,
+                                   struct sk_buff *skb,
+                                   struct nvf_rx_batch *rb) {
+  struct xdp_buff buf, *xdp;
+
+  if (rb->prog == NULL) {
+    return skb;
+  }
+
+  // The program sees the frame as it was on the wire.
+  __skb_push(skb, skb->data - skb_mac_header(skb));
+  if (unlikely(skb_is_gso(skb))) {
+    goto l_drop;
+  }
+  if (skb->ip_summed == CHECKSUM_PARTIAL && skb_checksum_help(skb)) {
+    goto l_drop;
+  }
+
+  xdp = nvf_rq_alloc_buff(rq, rb, &buf, skb->len);
+  if (unlikely(xdp == NULL)) {
+    goto l_drop;
+  }
+  if (skb_copy_bits(skb, 0, xdp->data, skb->len)) {
+    nvf_rq_free_buff(rq, xdp);
+    goto l_drop;
+  }
+  consume_skb(skb);
+
+  return nvf_xdp_run(navi, rq, xdp, rb);
+
+l_drop:
+  kfree_skb(skb);
+  rb->dropped++;
+  return NULL;
+}
+
+/**
+ * @brief Hand a received frame to the stack.
+ *
+ * @param rq Receive queue of the frame.
+ * @param skb Frame, already classified by eth_type_trans().
+ * @param rb State of the NAPI poll.
+ */
+static void nvf_rx_deliver(struct dummy_wifi_rq *rq, struct sk_buff *skb,
+                           struct nvf_rx_batch *rb) {
+  // The Ethernet header was pulled by eth_type_trans().
+  rb->packets++;
+  rb->bytes += skb->len + ETH_HLEN;
+  napi_gro_receive(&rq->napi, skb);
+}
+
+/**
+ * @brief Write a synthetic UDP/IPv4 frame received by a radio.
+ *
+ * The frame goes from a fixed locally administered address to the interface,
+ * and from 198.18.0.0 + @p flow to 198.19.0.1 (RFC 2544 benchmarking range),
+ * port 9. The payload is zeroed, the UDP checksum left out.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param data Buffer receiving the frame.
+ * @param len Length of the frame including the Ethernet header.
+ * @param flow Flow of the frame.
+ */
+static void nvf_gen_fill(struct dummy_wifi_context *navi, void *data,
+                         unsigned int len, u32 flow) {
+  static const u8 src_addr[ETH_ALEN] __aligned(2) = {0x02, 0x00, 0x00,
+                                                      0x00, 0x00, 0x01};
+  struct ethhdr *eth = data;
+  struct iphdr *iph = (struct iphdr *)(eth + 1);
+  struct udphdr *udph = (struct udphdr *)(iph + 1);
+
+  ether_addr_copy(eth->h_dest, navi->ndev->dev_addr);
+  ether_addr_copy(eth->h_source, src_addr);
+  eth->h_proto = htons(ETH_P_IP);
+
+  iph->version = 4;
+  iph->ihl = sizeof(*iph) >> 2;
+  iph->tos = 0;
+  iph->tot_len = htons(len - ETH_HLEN);
+  iph->id = 0;
+  iph->frag_off = htons(IP_DF);
+  iph->ttl = 64;
+  iph->protocol = IPPROTO_UDP;
+  iph->check = 0;
+  iph->saddr = htonl(NVF_GEN_SADDR + flow);
+  iph->daddr = htonl(NVF_GEN_DADDR);
+  iph->check = ip_fast_csum(iph, iph->ihl);
+
+  udph->source = htons(NVF_GEN_PORT);
+  udph->dest = htons(NVF_GEN_PORT);
+  udph->len = htons(len - ETH_HLEN - sizeof(*iph));
+  udph->check = 0;
+
+  memset(udph + 1, 0, len - ETH_HLEN - sizeof(*iph) - sizeof(*udph));
+}
+
+/**
+ * @brief Generate synthetic frames in the NAPI poll loop.
+ *
+ * Spends the credits granted by the generator timer, at most @p budget. The
+ * frames are written straight into receive buffers of the queue, so the XDP
+ * program, if any, runs on them and hands them to an AF_XDP socket without a
+ * copy; the others are handed to the stack through GRO.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param rq First receive queue of the radio.
+ * @param budget Maximum number of frames to generate.
+ * @param rb State of the NAPI poll.
+ *
+ * @return Number of frames generated.
+ */
+static int nvf_gen_rx(struct dummy_wifi_context *navi,
+                      struct dummy_wifi_rq *rq, int budget,
+                      struct nvf_rx_batch *rb) {
+  unsigned int len = clamp_t(unsigned int, READ_ONCE(navi->gen_size),
+                             ETH_ZLEN, navi->ndev->mtu + ETH_HLEN);
+  u32 flows = clamp_t(u32, READ_ONCE(navi->gen_flows), 1, NVF_GEN_MAX_FLOWS);
+  int n = min(atomic_read(&navi->gen_credits), budget);
+  struct xdp_buff buf, *xdp;
+  struct sk_buff *skb;
+  int done;
+
+  // The MTU is capped at ETH_DATA_LEN by ether_setup(): frames fit a page.
+  BUILD_BUG_ON(XDP_PACKET_HEADROOM + SKB_DATA_ALIGN(ETH_FRAME_LEN) +
+                   SKB_DATA_ALIGN(sizeof(struct skb_shared_info)) >
+               PAGE_SIZE);
+
+  for (done = 0; done < n; done++) {
+    xdp = nvf_rq_alloc_buff(rq, rb, &buf, len);
+    if (unlikely(xdp == NULL)) {
+      break;
+    }
+    nvf_gen_fill(navi, xdp->data, len, navi->gen_flow);
+    if (++navi->gen_flow >= flows) {
+      navi->gen_flow = 0;
+    }
+
+    if (rb->prog != NULL) {
+      skb = nvf_xdp_run(navi, rq, xdp, rb);
+    } else {
+      skb = nvf_xdp_build_skb(navi, rq, xdp);
+      if (likely(skb != NULL)) {
+        skb->ip_summed = CHECKSUM_UNNECESSARY;
+      }
+    }
+    if (skb != NULL) {
+      nvf_rx_deliver(rq, skb, rb);
+    }
+  }
+
+  atomic_sub(done, &navi->gen_credits);
+  WRITE_ONCE(navi->gen_packets, navi->gen_packets + done);
+
+  return done;
+}
+
+/**
+ * @brief Transmit the frames of the AF_XDP socket bound to a queue.
+ *
+ * The frames are read straight from the umem of the socket and copied once
+ * into socket buffers for the peer: there is no device to DMA from the umem,
+ * so the virtual wire is where the single copy of the zero-copy path happens.
+ * Completions are posted right away.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param rq Queue the socket is bound to.
+ * @param pool Buffer pool of the socket.
+ * @param budget Maximum number of frames to transmit.
+ *
+ * @return Number of descriptors consumed.
+ */
+static int nvf_xsk_tx(struct dummy_wifi_context *navi,
+                      struct dummy_wifi_rq *rq, struct xsk_buff_pool *pool,
+                      int budget) {
+  struct dummy_wifi_stats *stats;
+  struct xdp_desc desc;
+  struct sk_buff *skb;
+  int done = 0;
+
+  while (done < budget && xsk_tx_peek_desc(pool, &desc)) {
+    done++;
+    skb = desc.len < ETH_HLEN ? NULL : napi_alloc_skb(&rq->napi, desc.len);
+    if (unlikely(skb == NULL)) {
+      stats = this_cpu_ptr(navi->stats);
+      u64_stats_update_begin(&stats->syncp);
+      u64_stats_inc(&stats->tx_dropped);
+      u64_stats_update_end(&stats->syncp);
+      continue;
+    }
+    skb_put_data(skb, xsk_buff_raw_get_data(pool, desc.addr), desc.len);
+    nvf_xmit_skb(navi, skb, rq - navi->rq);
+  }
+
+  if (done) {
+    xsk_tx_release(pool);
+    xsk_tx_completed(pool, done);
+  }
+
+  return done;
+}
+
+/**
+ * @brief Complete the frames sent on the transmit queue of a NAPI context.
+ *
+ * Plays the part of the TX completion interrupt of a NIC: the bytes sent since
+ * the last poll are reported to Byte Queue Limits, which wakes the transmit
+ * queue if it stopped it. The sent counters only grow and are only written by
+ * nvf_ndo_start_xmit(), so the difference to the completed ones is what is in
+ * flight; unsigned wrap-around keeps it right.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param rq Receive queue, with the index of the transmit queue.
+ */
+static void nvf_tx_complete(struct dummy_wifi_context *navi,
+                            struct dummy_wifi_rq *rq) {
+  unsigned int pkts = READ_ONCE(rq->tx_sent_pkts) - rq->tx_done_pkts;
+  unsigned int bytes = READ_ONCE(rq->tx_sent_bytes) - rq->tx_done_bytes;
+
+  if (bytes == 0) {
+    return;
+  }
+
+  rq->tx_done_pkts += pkts;
+  rq->tx_done_bytes += bytes;
+  netdev_tx_completed_queue(netdev_get_tx_queue(navi->ndev, rq - navi->rq),
+                            pkts, bytes);
+}
+
+/**
+ * @brief Receive the frames heard on the shared medium in the NAPI poll loop.
+ *
+ * Receive queue N drains the medium rings of the CPUs whose number is N
+ * modulo the number of queues, at most @p budget frames. It is the only
+ * consumer of these rings, so no lock is needed.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param rq Receive queue polled.
+ * @param rings Medium rings of the radio.
+ * @param budget Maximum number of frames to receive.
+ * @param rb State of the NAPI poll.
+ *
+ * @return Number of frames received.
+ */
+static int nvf_air_rx(struct dummy_wifi_context *navi,
+                      struct dummy_wifi_rq *rq,
+                      struct ptr_ring __percpu *rings, int budget,
+                      struct nvf_rx_batch *rb) {
+  struct sk_buff *skb;
+  unsigned int cpu;
+  int done = 0;
+
+  for (cpu = rq - navi->rq; cpu < nr_cpu_ids && done < budget;
+       cpu += navi->n_queues) {
+    if (!cpu_possible(cpu)) {
+      continue;
+    }
+    while (done < budget &&
+           (skb = __ptr_ring_consume(per_cpu_ptr(rings, cpu))) != NULL) {
+      skb = nvf_rcv_skb(navi, rq, skb, rb);
+      if (skb != NULL) {
+        nvf_rx_deliver(rq, skb, rb);
+      }
+      done++;
+    }
+  }
+
+  return done;
+}
+
+/**
+ * @brief NAPI poll routine of the DummyWiFi receive queue.
+ *
+ * Drains up to @p budget frames from the receive ring, runs the XDP program
+ * of the device on them if there is one, and passes the others to the
+ * network stack through GRO. Socket buffers were already scrubbed and
+ * classified by __dev_forward_skb() on the transmit side of the peer. The
+ * first queue also delivers the frames of the RX traffic generator with the
+ * rest of the budget, and the queue transmits the frames of the AF_XDP socket
+ * bound to it, if any. XDP_TX frames, XDP redirects and the statistics are
+ * flushed once per poll rather than once per frame. Frames sent on the
+ * transmit queue of the same index are completed first, outside the budget.
+ *
+ * @param napi Pointer to the NAPI context embedded in the receive queue.
+ * @param budget Maximum number of frames to process in this poll.
+ *
+ * @return Number of frames processed.
+ */
+static int nvf_napi_poll(struct napi_struct *napi, int budget) {
+  struct dummy_wifi_rq *rq = container_of(napi, struct dummy_wifi_rq, napi);
+  struct dummy_wifi_context *navi = ndev_get_navi_context(napi->dev)->navi;
+  struct xsk_buff_pool *xsk_pool = READ_ONCE(rq->xsk_pool);
+  struct ptr_ring __percpu *rings;
+  struct dummy_wifi_stats *stats;
+  struct nvf_rx_batch rb = {};
+  struct sk_buff *skb;
+  void *ptr;
+  int done = 0;
+
+  nvf_tx_complete(navi, rq);
+
+  rcu_read_lock();
+  rb.prog = rcu_dereference(navi->xdp_prog);
+  if (rb.prog != NULL) {
+    rb.xsk_pool = xsk_pool;
+  }
+
+  // The ring has a single consumer (this poll routine), no lock is needed.
+  while (done < budget && (ptr = __ptr_ring_consume(&rq->ring)) != NULL) {
+    if (nvf_is_xdp_frame(ptr)) {
+      skb = nvf_rcv_xdp_frame(navi, rq, nvf_ptr_to_xdp(ptr), &rb);
+    } else {
+      skb = nvf_rcv_skb(navi, rq, ptr, &rb);
+    }
+    if (skb != NULL) {
+      nvf_rx_deliver(rq, skb, &rb);
+    }
+    done++;
+  }
+
+  // Frames heard on the shared medium, allocated on first attach.
+  rings = smp_load_acquire(&navi->air_rings);
+  if (rings != NULL && done < budget) {
+    done += nvf_air_rx(navi, rq, rings, budget - done, &rb);
+  }
+
+  // Generated frames; the timer re-schedules NAPI when it grants credits.
+  if (rq == navi->rq && done < budget &&
+      atomic_read(&navi->gen_credits) > 0) {
+    done += nvf_gen_rx(navi, rq, budget - done, &rb);
+  }
+
+  // Frames of the AF_XDP socket, woken up by nvf_ndo_xsk_wakeup().
+  if (xsk_pool != NULL && done < budget) {
+    done += nvf_xsk_tx(navi, rq, xsk_pool, budget - done);
+  }
+
+  if (rb.n_xdp_tx) {
+    nvf_xdp_tx_flush(navi, &rb);
+  }
+  if (rb.xdp_redirect) {
+    xdp_do_flush();
+  }
+  rcu_read_unlock();
+
+  if (rb.packets || rb.dropped) {
+    stats = this_cpu_ptr(navi->stats);
+    u64_stats_update_begin(&stats->syncp);
+    u64_stats_add(&stats->rx_packets, rb.packets);
+    u64_stats_add(&stats->rx_bytes, rb.bytes);
+    u64_stats_add(&stats->rx_dropped, rb.dropped);
+    u64_stats_update_end(&stats->syncp);
+  }
+
+  // Ring drained: leave polling mode. A producer racing with us re-schedules
+  // NAPI through the MISSED state, so no frame is left behind.
+  if (done < budget) {
+    napi_complete_done(napi, done);
+  }
+
+  return done;
+}
+
+/**
+ * @brief Get the airtime clock of the medium a radio transmits on.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ *
+ * @return The clock of the shared medium of the radio, or its own.
+ */
+static atomic64_t *nvf_airtime_clock(struct dummy_wifi_context *navi) {
+  struct nvf_air *air = READ_ONCE(navi->air);
+
+  return air != NULL ? &air->busy_until : &navi->tx_busy_until;
+}
+
+/**
+ * @brief Charge the airtime of a frame to the medium of a radio.
+ *
+ * The medium is a virtual clock shared by all transmit queues: each frame
+ * occupies it for its length at the PHY rate, plus a fixed overhead per
+ * (segmented) frame, starting when the previous frame is done. Radios on a
+ * shared medium share its clock, and thus contend for its airtime.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param skb Frame to transmit.
+ *
+ * @return Airtime queued ahead of now in ns, the frame included; 0 when the
+ *         rate is unknown (not connected and no forced rate).
+ */
+static u64 nvf_airtime_charge(struct dummy_wifi_context *navi,
+                              const struct sk_buff *skb) {
+  u32 rate = READ_ONCE(navi->tx_rate_kbps) ?: READ_ONCE(navi->link_rate_kbps);
+  u32 segs = skb_is_gso(skb) ? skb_shinfo(skb)->gso_segs : 1;
+  atomic64_t *clock = nvf_airtime_clock(navi);
+  u64 now, start, airtime;
+  s64 old;
+
+  if (rate == 0) {
+    return 0;
+  }
+
+  // bits / (kbit/s) gives ms, scaled to ns.
+  airtime = div_u64((u64)skb->len * BITS_PER_BYTE * USEC_PER_SEC, rate) +
+            (u64)READ_ONCE(navi->tx_overhead_us) * NSEC_PER_USEC * segs;
+
+  now = ktime_get_ns();
+  old = atomic64_read(clock);
+  do {
+    start = max_t(u64, old, now);
+  } while (!atomic64_try_cmpxchg(clock, &old, start + airtime));
+
+  return start + airtime - now;
+}
+
+/**
+ * @brief Airtime pacing timer callback.
+ *
+ * Wakes the transmit queues stopped because too much airtime was queued.
+ * Queues that are still ahead of the medium stop again on their next frame.
+ *
+ * @param timer Pointer to the pacing timer of the radio.
+ *
+ * @return HRTIMER_NORESTART.
+ */
+static enum hrtimer_restart dummy_wifi_tx_timer(struct hrtimer *timer) {
+  struct dummy_wifi_context *navi =
+      container_of(timer, struct dummy_wifi_context, tx_timer);
+
+  netif_tx_wake_all_queues(navi->ndev);
+
+  return HRTIMER_NORESTART;
+}
+
+/**
+ * @brief Arm the timer of a delay wheel for a tick, unless it fires earlier.
+ *
+ * Must be called with the lock of the wheel held.
+ *
+ * @param w Delay wheel.
+ * @param tick Tick in which frames are due.
+ */
+static void nvf_wheel_arm(struct nvf_wheel *w, u64 tick) {
+  if (w->armed && w->armed_tick <= tick) {
+    return;
+  }
+
+  w->armed = true;
+  w->armed_tick = tick;
+  hrtimer_start(&w->timer, ns_to_ktime(tick * NVF_WHEEL_TICK_NS),
+                HRTIMER_MODE_ABS_SOFT);
+}
+
+/**
+ * @brief Delay wheel timer callback.
+ *
+ * Takes the frames of all the slots due by now out of the wheel, re-arms the
+ * timer for the next non-empty slot, and forwards the frames to the peer
+ * outside the lock.
+ *
+ * @param timer Pointer to the timer of the wheel.
+ *
+ * @return HRTIMER_NORESTART, the timer is re-armed with nvf_wheel_arm().
+ */
+static enum hrtimer_restart nvf_wheel_timer(struct hrtimer *timer) {
+  struct nvf_wheel *w = container_of(timer, struct nvf_wheel, timer);
+  u64 now_tick = div_u64(ktime_get_ns(), NVF_WHEEL_TICK_NS);
+  struct sk_buff *head = NULL, **tail = &head, *skb;
+  struct nvf_wheel_slot *slot;
+
+  spin_lock(&w->lock);
+  w->armed = false;
+
+  // A late timer must not go round the wheel more than once.
+  if (now_tick >= w->next_tick + NVF_WHEEL_SLOTS) {
+    now_tick = w->next_tick + NVF_WHEEL_SLOTS - 1;
+  }
+  for (; w->queued && w->next_tick <= now_tick; w->next_tick++) {
+    slot = &w->slot[w->next_tick & (NVF_WHEEL_SLOTS - 1)];
+    if (slot->head != NULL) {
+      *tail = slot->head;
+      tail = &slot->tail->next;
+      // Stop the walk as soon as the wheel is empty.
+      for (skb = slot->head; skb != NULL; skb = skb->next) {
+        w->queued--;
+      }
+      slot->head = slot->tail = NULL;
+    }
+  }
+
+  // Skip the empty slots, the wheel is sparse at low rates.
+  if (w->queued) {
+    while (w->slot[w->next_tick & (NVF_WHEEL_SLOTS - 1)].head == NULL) {
+      w->next_tick++;
+    }
+    nvf_wheel_arm(w, w->next_tick);
+  }
+  spin_unlock(&w->lock);
+
+  while (head != NULL) {
+    skb = head;
+    head = skb->next;
+    skb_mark_not_on_list(skb);
+    nvf_xmit_skb(w->navi, skb, skb_get_queue_mapping(skb));
+  }
+
+  return HRTIMER_NORESTART;
+}
+
+/**
+ * @brief Queue a frame on the delay wheel of a radio.
+ *
+ * @param w Delay wheel.
+ * @param skb Frame to delay.
+ * @param delay_ns Delay of the frame.
+ */
+static void nvf_wheel_add(struct nvf_wheel *w, struct sk_buff *skb,
+                          u64 delay_ns) {
+  u64 now = ktime_get_ns();
+  u64 tick = div_u64(now + delay_ns, NVF_WHEEL_TICK_NS);
+  struct nvf_wheel_slot *slot;
+
+  spin_lock(&w->lock);
+
+  // An empty wheel starts over at the current tick.
+  if (w->queued == 0) {
+    w->next_tick = div_u64(now, NVF_WHEEL_TICK_NS);
+  }
+  tick = clamp_t(u64, tick, w->next_tick, w->next_tick + NVF_WHEEL_SLOTS - 1);
+
+  slot = &w->slot[tick & (NVF_WHEEL_SLOTS - 1)];
+  skb->next = NULL;
+  if (slot->tail != NULL) {
+    slot->tail->next = skb;
+  } else {
+    slot->head = skb;
+  }
+  slot->tail = skb;
+  w->queued++;
+  nvf_wheel_arm(w, tick);
+
+  spin_unlock(&w->lock);
+}
+
+/**
+ * @brief Drop the frames waiting on the delay wheel of a radio.
+ *
+ * Must be called once the radio cannot transmit anymore.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ */
+static void nvf_wheel_flush(struct dummy_wifi_context *navi) {
+  struct nvf_wheel *w = navi->wheel;
+  struct sk_buff *skb;
+  unsigned int i;
+
+  if (w == NULL) {
+    return;
+  }
+
+  hrtimer_cancel(&w->timer);
+  spin_lock_bh(&w->lock);
+  for (i = 0; i < NVF_WHEEL_SLOTS; i++) {
+    while ((skb = w->slot[i].head) != NULL) {
+      w->slot[i].head = skb->next;
+      kfree_skb(skb);
+    }
+    w->slot[i].tail = NULL;
+  }
+  w->queued = 0;
+  w->armed = false;
+  spin_unlock_bh(&w->lock);
+}
+
+/**
+ * @brief Send a frame over the impaired link of a radio.
+ *
+ * Emulates a lossy link, netem-style: the frame is lost with probability
+ * link_loss_ppm, and otherwise delayed by link_delay_us plus or minus a
+ * random jitter of up to link_jitter_us on the delay wheel. With probability
+ * link_reorder_ppm, a frame skips the delay and overtakes the frames still on
+ * the wheel. Without impairments the frame is forwarded at once.
+ *
+ * @param navi Pointer to the DummyWiFi context of the sending radio.
+ * @param skb Frame to send.
+ * @param qid Transmit queue of the frame.
+ */
+static void nvf_link_xmit(struct dummy_wifi_context *navi, struct sk_buff *skb,
+                          u16 qid) {
+  u32 loss = READ_ONCE(navi->link_loss_ppm);
+  u64 delay = (u64)READ_ONCE(navi->link_delay_us) * NSEC_PER_USEC;
+  u64 jitter = (u64)READ_ONCE(navi->link_jitter_us) * NSEC_PER_USEC;
+  struct nvf_wheel *w = smp_load_acquire(&navi->wheel);
+  struct dummy_wifi_stats *stats;
+
+  if (unlikely(loss) && get_random_u32_below(NVF_PPM) < loss) {
+    kfree_skb(skb);
+    atomic_long_inc(&navi->link_lost);
+    stats = this_cpu_ptr(navi->stats);
+    u64_stats_update_begin(&stats->syncp);
+    u64_stats_inc(&stats->tx_dropped);
+    u64_stats_update_end(&stats->syncp);
+    return;
+  }
+
+  if (likely(w == NULL || (delay == 0 && jitter == 0))) {
+    nvf_xmit_skb(navi, skb, qid);
+    return;
+  }
+
+  if (get_random_u32_below(NVF_PPM) < READ_ONCE(navi->link_reorder_ppm)) {
+    atomic_long_inc(&navi->link_reordered);
+    nvf_xmit_skb(navi, skb, qid);
+    return;
+  }
+
+  // Uniform in [delay - jitter, delay + jitter], but not negative.
+  if (jitter) {
+    delay += get_random_u32_below(2 * jitter + 1);
+    delay = delay > jitter ? delay - jitter : 0;
+  }
+  atomic_long_inc(&navi->link_delayed);
+  nvf_wheel_add(w, skb, delay);
+}
+
+/**
+ * @brief This function is the network device driver's start_xmit callback.
+ *
+ * It is called when the network stack wants to transmit a packet using
+ * the specified network device. The frame is forwarded to the peer device
+ * over the emulated link, see nvf_link_xmit() and nvf_xmit_skb(). Note that
+ * the skb ownership is transferred to this
+ * callback, so it is responsible for cleanup when the frame cannot be
+ * delivered.
+ *
+ * With airtime pacing, the frame is charged its airtime on the medium of the
+ * radio. It is delivered right away, but once more than the burst of airtime
+ * is queued ahead the transmit queue is stopped until the medium catches up,
+ * so the backlog builds up in the qdisc as on a real Wi-Fi bottleneck.
+ *
+ * Transmission is accounted to Byte Queue Limits, and completed in the NAPI
+ * poll of the queue with the same index rather than here, see
+ * nvf_tx_complete(). BQL stops the queue once too many bytes are in flight,
+ * which keeps the queueing delay below the qdisc (e.g. fq_codel) short.
+ *
+ * @param skb Pointer to the socket buffer containing the packet to be
+ * transmitted.
+ * @param dev Pointer to the network device structure.
+ *
+ * @return Returns NETDEV_TX_OK to indicate that the packet was consumed
+ *         (delivered to the peer or dropped).
+ */
+static netdev_tx_t nvf_ndo_start_xmit(struct sk_buff *skb,
+                                      struct net_device *dev) {
+  struct dummy_wifi_context *navi = ndev_get_navi_context(dev)->navi;
+  u16 qid = skb_get_queue_mapping(skb);
+  struct netdev_queue *txq = netdev_get_tx_queue(dev, qid);
+  struct dummy_wifi_rq *rq = &navi->rq[qid];
+  unsigned int len = skb->len;
+  u64 backlog = 0, burst;
+
+  if (READ_ONCE(navi->airtime)) {
+    backlog = nvf_airtime_charge(navi, skb);
+  }
+
+  nvf_link_xmit(navi, skb, qid);
+
+  // Dropped and delayed frames are completed too. The queue lock serializes
+  // the writers.
+  WRITE_ONCE(rq->tx_sent_pkts, rq->tx_sent_pkts + 1);
+  WRITE_ONCE(rq->tx_sent_bytes, rq->tx_sent_bytes + len);
+  if (__netdev_tx_sent_queue(txq, len, netdev_xmit_more())) {
+    napi_schedule(&rq->napi);
+  }
+
+  burst = (u64)READ_ONCE(navi->tx_burst_us) * NSEC_PER_USEC;
+  if (unlikely(backlog > burst)) {
+    // The timer is armed after the queue is stopped, so no wakeup is lost.
+    netif_tx_stop_queue(txq);
+    atomic_long_inc(&navi->tx_stops);
+    hrtimer_start(&navi->tx_timer, ns_to_ktime(backlog - burst),
+                  HRTIMER_MODE_REL_SOFT);
+  }
+
+  return NETDEV_TX_OK;
+}
+
+/**
+ * @brief Bring the DummyWiFi network device up.
+ *
+ * Enables the NAPI contexts of the receive queues so that frames sent by the
+ * peer are delivered.
+ *
+ * @param dev Pointer to the network device structure.
+ *
+ * @return Always 0.
+ */
+static int nvf_ndo_open(struct net_device *dev) {
+  struct dummy_wifi_context *navi = ndev_get_navi_context(dev)->navi;
+  unsigned int i;
+
+  for (i = 0; i < navi->n_queues; i++) {
+    napi_enable(&navi->rq[i].napi);
+  }
+  netif_tx_start_all_queues(dev);
+
+  return 0;
+}
+
+/**
+ * @brief Bring the DummyWiFi network device down.
+ *
+ * Reports the scan in progress as aborted, stops transmission, disables NAPI
+ * and drops the frames that are still waiting on the receive rings. Frames
+ * that were sent but not completed yet are forgotten along with the Byte
+ * Queue Limits state.
+ *
+ * @param dev Pointer to the network device structure.
+ *
+ * @return Always 0.
+ */
+static int nvf_ndo_stop(struct net_device *dev) {
+  struct dummy_wifi_context *navi = ndev_get_navi_context(dev)->navi;
+  unsigned int i;
+  void *ptr;
+  int cpu;
+
+  // cfg80211 frees the scan request once the device is down.
+  dummy_wifi_scan_stop(navi);
+
+  netif_tx_stop_all_queues(dev);
+  hrtimer_cancel(&navi->tx_timer);
+  nvf_wheel_flush(navi);
+  for (i = 0; i < navi->n_queues; i++) {
+    napi_disable(&navi->rq[i].napi);
+
+    // NAPI is disabled, so we are the only consumer of the ring now.
+    while ((ptr = __ptr_ring_consume(&navi->rq[i].ring)) != NULL) {
+      nvf_ring_free(ptr);
+    }
+
+    // The core waited for running transmissions before calling us.
+    navi->rq[i].tx_sent_pkts = navi->rq[i].tx_done_pkts = 0;
+    navi->rq[i].tx_sent_bytes = navi->rq[i].tx_done_bytes = 0;
+    netdev_tx_reset_queue(netdev_get_tx_queue(dev, i));
+  }
+
+  // Likewise for the medium rings, all of their consumers are disabled.
+  if (navi->air_rings != NULL) {
+    for_each_possible_cpu(cpu) {
+      while ((ptr = __ptr_ring_consume(per_cpu_ptr(navi->air_rings, cpu))) !=
+             NULL) {
+        nvf_ring_free(ptr);
+      }
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Report the statistics of a DummyWiFi network device.
+ *
+ * Sums up the per-CPU counters. Drops accounted by the core (e.g. frames
+ * rejected by __dev_forward_skb()) are added by dev_get_stats().
+ *
+ * @param dev Pointer to the network device structure.
+ * @param tot Statistics to fill in.
+ */
+static void nvf_ndo_get_stats64(struct net_device *dev,
+                                struct rtnl_link_stats64 *tot) {
+  struct dummy_wifi_context *navi = ndev_get_navi_context(dev)->navi;
+  u64 rx_packets, rx_bytes, rx_dropped, tx_packets, tx_bytes, tx_dropped;
+  const struct dummy_wifi_stats *stats;
+  unsigned int start;
+  int cpu;
+
+  for_each_possible_cpu(cpu) {
+    stats = per_cpu_ptr(navi->stats, cpu);
+    do {
+      start = u64_stats_fetch_begin(&stats->syncp);
+      rx_packets = u64_stats_read(&stats->rx_packets);
+      rx_bytes = u64_stats_read(&stats->rx_bytes);
+      rx_dropped = u64_stats_read(&stats->rx_dropped);
+      tx_packets = u64_stats_read(&stats->tx_packets);
+      tx_bytes = u64_stats_read(&stats->tx_bytes);
+      tx_dropped = u64_stats_read(&stats->tx_dropped);
+    } while (u64_stats_fetch_retry(&stats->syncp, start));
+
+    tot->rx_packets += rx_packets;
+    tot->rx_bytes += rx_bytes;
+    tot->rx_dropped += rx_dropped;
+    tot->tx_packets += tx_packets;
+    tot->tx_bytes += tx_bytes;
+    tot->tx_dropped += tx_dropped;
+  }
+}
+
+/**
+ * @brief Wake up the AF_XDP socket bound to a queue.
+ *
+ * Schedules NAPI of the queue, which transmits the frames of the socket.
+ *
+ * @param dev Pointer to the network device structure.
+ * @param qid Queue of the socket.
+ * @param flags XDP_WAKEUP_* flags.
+ *
+ * @return 0 on success, -ENETDOWN if the device is down, -EINVAL if no socket
+ *         is bound to the queue.
+ */
+static int nvf_ndo_xsk_wakeup(struct net_device *dev, u32 qid, u32 flags) {
+  struct dummy_wifi_context *navi = ndev_get_navi_context(dev)->navi;
+
+  if (!netif_running(dev)) {
+    return -ENETDOWN;
+  }
+  if (qid >= navi->n_queues || READ_ONCE(navi->rq[qid].xsk_pool) == NULL) {
+    return -EINVAL;
+  }
+
+  // Run the poll loop right away when we return to softirq-enabled context.
+  local_bh_disable();
+  napi_schedule(&navi->rq[qid].napi);
+  local_bh_enable();
+
+  return 0;
+}
+
+/**
+ * @brief Fix up the offloads of a DummyWiFi network device.
+ *
+ * XDP programs see a frame as a single page, so a device stops handing GSO
+ * frames to a peer running an XDP program. Frames sent on a shared medium
+ * are segmented for such receivers by nvf_air_deliver() instead.
+ *
+ * @param dev Pointer to the network device structure.
+ * @param features Requested features.
+ *
+ * @return The features the device can use.
+ */
+static netdev_features_t nvf_ndo_fix_features(struct net_device *dev,
+                                              netdev_features_t features) {
+  struct dummy_wifi_context *navi = ndev_get_navi_context(dev)->navi;
+  struct dummy_wifi_context *peer;
+
+  rcu_read_lock();
+  peer = rcu_dereference(navi->peer);
+  if (peer != NULL && rcu_access_pointer(peer->xdp_prog) != NULL) {
+    features &= ~NETIF_F_GSO_SOFTWARE;
+  }
+  rcu_read_unlock();
+
+  return features;
+}
+
+/**
+ * @brief Attach or detach the XDP program of a DummyWiFi network device.
+ *
+ * The program applies to all receive queues. Called with the RTNL held, which
+ * also keeps the peer stable.
+ *
+ * @param dev Pointer to the network device structure.
+ * @param prog New program, NULL to detach; its reference is handed over.
+ *
+ * @return Always 0.
+ */
+static int nvf_xdp_set_prog(struct net_device *dev, struct bpf_prog *prog) {
+  struct dummy_wifi_context *navi = ndev_get_navi_context(dev)->navi;
+  struct dummy_wifi_context *peer;
+  struct bpf_prog *old;
+
+  old = rcu_replace_pointer(navi->xdp_prog, prog, lockdep_rtnl_is_held());
+  if (old != NULL) {
+    bpf_prog_put(old);
+  }
+
+  // The peer has to stop (or may resume) sending GSO frames.
+  peer = rcu_dereference_protected(navi->peer, lockdep_rtnl_is_held());
+  if (peer != NULL) {
+    netdev_update_features(peer->ndev);
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Bind or unbind the AF_XDP buffer pool of a queue.
+ *
+ * The pool is DMA mapped against the parent device, as AF_XDP requires of
+ * zero-copy drivers; the mapping is the identity and the buffers are only
+ * touched by the CPU. NAPI of the queue is paused while the pool changes,
+ * as the poll loop uses it without locking. Called with the RTNL held.
+ *
+ * @param dev Pointer to the network device structure.
+ * @param pool Pool to bind, NULL to unbind.
+ * @param qid Queue of the pool.
+ *
+ * @return 0 on success, -EINVAL for a bad queue, -EBUSY if a pool is already
+ *         bound, or the error of the DMA mapping or rxq registration.
+ */
+static int nvf_xsk_pool_setup(struct net_device *dev,
+                              struct xsk_buff_pool *pool, u16 qid) {
+  struct dummy_wifi_context *navi = ndev_get_navi_context(dev)->navi;
+  bool running = netif_running(dev);
+  struct dummy_wifi_rq *rq;
+  int err;
 
-  // Reset the disconnect reason code to 0 to indicate a clean disconnection.
-  navi->disconnect_reason_code = 0;
+  if (qid >= navi->n_queues) {
+    return -EINVAL;
+  }
+  rq = &navi->rq[qid];
+
+  if (pool != NULL) {
+    if (rq->xsk_pool != NULL) {
+      return -EBUSY;
+    }
+    err = xsk_pool_dma_map(pool, dev->dev.parent, 0);
+    if (err) {
+      return err;
+    }
+    err = xdp_rxq_info_reg(&rq->xsk_rxq, dev, qid, rq->napi.napi_id);
+    if (err) {
+      goto l_error_unmap;
+    }
+    err = xdp_rxq_info_reg_mem_model(&rq->xsk_rxq, MEM_TYPE_XSK_BUFF_POOL,
+                                     NULL);
+    if (err) {
+      goto l_error_unreg;
+    }
+    xsk_pool_set_rxq_info(pool, &rq->xsk_rxq);
+
+    // Transmission is only driven by wakeups; reception needs none.
+    if (xsk_uses_need_wakeup(pool)) {
+      xsk_set_tx_need_wakeup(pool);
+      xsk_clear_rx_need_wakeup(pool);
+    }
+  } else if (rq->xsk_pool == NULL) {
+    return 0;
+  }
+
+  if (running) {
+    napi_disable(&rq->napi);
+  }
+  swap(rq->xsk_pool, pool);
+  if (running) {
+    napi_enable(&rq->napi);
+  }
+
+  // Unbinding: pool is now the pool that was bound.
+  if (rq->xsk_pool == NULL) {
+    xdp_rxq_info_unreg(&rq->xsk_rxq);
+    xsk_pool_dma_unmap(pool, 0);
+  }
 
-  // Release the previously acquired semaphore to allow other threads to access
-  // shared resources.
-  up(&navi->sem);
+  return 0;
+
+l_error_unreg:
+  xdp_rxq_info_unreg(&rq->xsk_rxq);
+l_error_unmap:
+  xsk_pool_dma_unmap(pool, 0);
+  return err;
 }
 
 /**
- * @brief Initiates a scan operation on a wireless device.
+ * @brief BPF control operations of a DummyWiFi network device.
  *
- * This function is responsible for initiating a scan operation on a given
- * wireless device. It acquires the necessary synchronization semaphore and
- * schedules a work item to perform the scan.
+ * @param dev Pointer to the network device structure.
+ * @param bpf Command and its arguments.
  *
- * @param wiphy The wireless PHY device for which the scan is to be initiated.
- * @param request The scan request configuration.
- * @return 0 on success, -ERESTARTSYS if interrupted by a signal, -EBUSY if
- *         another scan operation is already in progress.
+ * @return 0 on success, a negative error code otherwise (-EINVAL for
+ *         unsupported commands).
  */
-static int nvf_scan(struct wiphy *wiphy,
-                    struct cfg80211_scan_request *request) {
-  // Obtain the DummyWiFi context associated with the wireless PHY device.
-  struct dummy_wifi_context *navi = wiphy_get_navi_context(wiphy)->navi;
+static int nvf_ndo_bpf(struct net_device *dev, struct netdev_bpf *bpf) {
+  switch (bpf->command) {
+  case XDP_SETUP_PROG:
+    return nvf_xdp_set_prog(dev, bpf->prog);
+  case XDP_SETUP_XSK_POOL:
+    return nvf_xsk_pool_setup(dev, bpf->xsk.pool, bpf->xsk.queue_id);
+  default:
+    return -EINVAL;
+  }
+}
+
+/**
+ * @brief Transmit XDP frames redirected to a DummyWiFi network device.
+ *
+ * The frames go to the peer like the frames of ndo_start_xmit(), and its
+ * NAPI is always scheduled, so XDP_XMIT_FLUSH needs no extra work.
+ *
+ * @param dev Pointer to the network device structure.
+ * @param n Number of frames.
+ * @param frames XDP frames to transmit.
+ * @param flags XDP_XMIT_* flags.
+ *
+ * @return Number of frames sent, the core frees the others; -EINVAL for
+ *         unknown flags.
+ */
+static int nvf_ndo_xdp_xmit(struct net_device *dev, int n,
+                            struct xdp_frame **frames, u32 flags) {
+  struct dummy_wifi_context *navi = ndev_get_navi_context(dev)->navi;
 
-  // Attempt to acquire the synchronization semaphore; this prevents concurrent
-  // access to DummyWiFi context.
-  if (down_interruptible(&navi->sem)) {
-    // The semaphore acquisition was interrupted by a signal, so return an
-    // error.
-    return -ERESTARTSYS;
+  if (unlikely(flags & ~XDP_XMIT_FLAGS_MASK)) {
+    return -EINVAL;
   }
 
-  // Check if there's already a scan request in progress; if so, release the
-  // semaphore and return an error indicating that the device is busy.
-  if (navi->scan_request != NULL) {
-    up(&navi->sem); // Release the semaphore.
-    return -EBUSY;
+  return nvf_xdp_xmit_frames(navi, frames, n);
+}
+
+/**
+ * @brief Network device operations structure for NVF driver
+ *
+ * This structure defines the network device operations for the NVF driver.
+ * It specifies functions that should be implemented to handle various network
+ * device tasks.
+ * Structure of functions for network devices. It should have at least
+ * ndo_start_xmit functions that called for packet to be sent.
+ */
+static struct net_device_ops nvf_ndev_ops = {
+    /**
+     * @brief Start transmission of a network packet
+     *
+     * This function is responsible for initiating the transmission of a network
+     * packet. It is part of the network device operations and is called when
+     * the network device needs to send a packet.
+     *
+     * @param skb Pointer to the network packet to be transmitted.
+     * @param dev Pointer to the network device.
+     * @return 0 on success, an error code on failure.
+     */
+    .ndo_start_xmit = nvf_ndo_start_xmit,
+
+    /**
+     * @brief Bring the network device up and enable its receive path.
+     */
+    .ndo_open = nvf_ndo_open,
+
+    /**
+     * @brief Bring the network device down and flush its receive path.
+     */
+    .ndo_stop = nvf_ndo_stop,
+
+    /**
+     * @brief Sum up the per-CPU interface statistics.
+     */
+    .ndo_get_stats64 = nvf_ndo_get_stats64,
+
+    /**
+     * @brief Drop GSO while the peer runs an XDP program.
+     */
+    .ndo_fix_features = nvf_ndo_fix_features,
+
+    /**
+     * @brief Attach and detach native XDP programs.
+     */
+    .ndo_bpf = nvf_ndo_bpf,
+
+    /**
+     * @brief Transmit frames redirected by XDP programs.
+     */
+    .ndo_xdp_xmit = nvf_ndo_xdp_xmit,
+
+    /**
+     * @brief Kick the transmission of an AF_XDP socket.
+     */
+    .ndo_xsk_wakeup = nvf_ndo_xsk_wakeup,
+};
+
+/**
+ * @brief Show the state machine of a radio in debugfs.
+ *
+ * Prints the current link state, the scanning flag and the contention
+ * counters of the radio.
+ *
+ * @param m Sequential file to print to.
+ * @param v Unused iterator value.
+ *
+ * @return Always 0.
+ */
+static int dummy_wifi_state_show(struct seq_file *m, void *v) {
+  static const char *const link_names[] = {
+      [DUMMY_WIFI_LINK_IDLE] = "idle",
+      [DUMMY_WIFI_LINK_CONNECTING] = "connecting",
+      [DUMMY_WIFI_LINK_CONNECTED] = "connected",
+      [DUMMY_WIFI_LINK_DISCONNECTING] = "disconnecting",
+  };
+  struct dummy_wifi_context *navi = m->private;
+  int state = atomic_read(&navi->state);
+  struct nvf_air *air;
+
+  seq_printf(m, "link: %s\n", link_names[state & DUMMY_WIFI_LINK_MASK]);
+  seq_printf(m, "scanning: %d\n", !!(state & DUMMY_WIFI_STATE_SCANNING));
+  seq_printf(m, "retries: %ld\n", atomic_long_read(&navi->state_retries));
+  seq_printf(m, "busy: %ld\n", atomic_long_read(&navi->state_busy));
+  if ((state & DUMMY_WIFI_LINK_MASK) == DUMMY_WIFI_LINK_CONNECTED) {
+    seq_printf(m, "bssid: %pM\n", navi->connected_bssid);
+  }
+  seq_printf(m, "roams: %ld\n", atomic_long_read(&navi->roams));
+  air = READ_ONCE(navi->air);
+  if (air != NULL) {
+    seq_printf(m, "medium: %u MHz\n", air->chan->center_freq);
+    seq_printf(m, "medium_frames: %ld\n", atomic_long_read(&air->frames));
   }
 
-  // Set the scan request in the DummyWiFi context to the provided request.
-  navi->scan_request = request;
+  return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(dummy_wifi_state);
+
+/**
+ * @brief Show the scan statistics of a radio in debugfs.
+ *
+ * @param m Sequential file to print to.
+ * @param v Unused iterator value.
+ *
+ * @return Always 0.
+ */
+static int dummy_wifi_scan_stats_show(struct seq_file *m, void *v) {
+  struct dummy_wifi_context *navi = m->private;
+
+  seq_printf(m, "scans: %llu\n", READ_ONCE(navi->scan_count));
+  seq_printf(m, "bss_reported: %llu\n", READ_ONCE(navi->scan_bss_reported));
+  seq_printf(m, "bss_unlinked: %llu\n", READ_ONCE(navi->scan_bss_unlinked));
+  seq_printf(m, "inform_ns: %llu\n", READ_ONCE(navi->scan_inform_ns));
+  seq_printf(m, "inform_max_ns: %llu\n", READ_ONCE(navi->scan_inform_max_ns));
+  seq_printf(m, "sched_scans: %llu\n", READ_ONCE(navi->sched_scan_count));
+  seq_printf(m, "sched_scan_results: %llu\n",
+             READ_ONCE(navi->sched_scan_results));
+  seq_printf(m, "sched_scan_ns: %llu\n", READ_ONCE(navi->sched_scan_ns));
+
+  return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(dummy_wifi_scan_stats);
+
+/**
+ * @brief Show the latency histograms of the control operations in debugfs.
+ *
+ * For each operation and phase, prints the non-empty buckets as
+ * "[low, high) ns: count".
+ *
+ * @param m Sequential file to print to.
+ * @param v Unused iterator value.
+ *
+ * @return Always 0.
+ */
+static int dummy_wifi_latency_show(struct seq_file *m, void *v) {
+  static const char *const op_names[NVF_N_OPS] = {
+      [NVF_OP_SCAN] = "scan",
+      [NVF_OP_CONNECT] = "connect",
+      [NVF_OP_DISCONNECT] = "disconnect",
+      [NVF_OP_ROAM] = "roam",
+  };
+  static const char *const phase_names[NVF_N_PHASES] = {
+      [NVF_PHASE_QUEUE] = "queue",
+      [NVF_PHASE_EXEC] = "exec",
+      [NVF_PHASE_REPORT] = "report",
+      [NVF_PHASE_TOTAL] = "total",
+      [NVF_PHASE_ABORT] = "abort",
+  };
+  struct dummy_wifi_context *navi = m->private;
+  unsigned int op, phase, k;
+  u64 n;
+
+  for (op = 0; op < NVF_N_OPS; op++) {
+    for (phase = 0; phase < NVF_N_PHASES; phase++) {
+      seq_printf(m, "%s %s:\n", op_names[op], phase_names[phase]);
+      for (k = 0; k < NVF_HIST_BUCKETS; k++) {
+        n = READ_ONCE(navi->ops[op].hist[phase][k]);
+        if (n == 0) {
+          continue;
+        }
+        if (k == NVF_HIST_BUCKETS - 1) {
+          seq_printf(m, "  [%llu, ...) ns: %llu\n", 1ULL << k, n);
+        } else {
+          seq_printf(m, "  [%llu, %llu) ns: %llu\n", k ? 1ULL << k : 0,
+                     1ULL << (k + 1), n);
+        }
+      }
+    }
+  }
+
+  return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(dummy_wifi_latency);
+
+/**
+ * @brief RX traffic generator timer callback.
+ *
+ * Grants the NAPI poll loop of the first receive queue credits for the frames
+ * due since the previous tick, and schedules it. Fractions of frames are
+ * carried over, so the average rate is exact whatever the period. Credits
+ * beyond two bursts are dropped and counted as overruns, so a receiver that
+ * cannot keep up sees the configured rate instead of an ever growing backlog.
+ *
+ * @param timer Pointer to the generator timer of the radio.
+ *
+ * @return HRTIMER_RESTART while the generator is enabled.
+ */
+static enum hrtimer_restart dummy_wifi_gen_timer(struct hrtimer *timer) {
+  struct dummy_wifi_context *navi =
+      container_of(timer, struct dummy_wifi_context, gen_timer);
+  u32 pps = READ_ONCE(navi->gen_pps);
+  u32 burst = max(READ_ONCE(navi->gen_burst), 1U);
+  int credits, cap = max_t(u32, min(burst, INT_MAX / 2) * 2, NAPI_POLL_WEIGHT);
+  u64 period, elapsed, due;
+
+  if (pps == 0) {
+    return HRTIMER_NORESTART;
+  }
+
+  period = max_t(u64, div_u64((u64)burst * NSEC_PER_SEC, pps),
+                 NVF_GEN_PERIOD_MIN_NS);
+  elapsed = min_t(u64, hrtimer_forward_now(timer, ns_to_ktime(period)) * period,
+                  NSEC_PER_SEC);
 
-  // Release the semaphore, allowing other operations to proceed.
-  up(&navi->sem);
+  navi->gen_frac += elapsed * pps;
+  due = div64_u64(navi->gen_frac, NSEC_PER_SEC);
+  navi->gen_frac -= due * NSEC_PER_SEC;
+
+  credits = atomic_read(&navi->gen_credits);
+  if (credits >= cap) {
+    WRITE_ONCE(navi->gen_overruns, navi->gen_overruns + due);
+    due = 0;
+  } else if (due > cap - credits) {
+    WRITE_ONCE(navi->gen_overruns,
+               navi->gen_overruns + due - (cap - credits));
+    due = cap - credits;
+  }
+  if (due) {
+    atomic_add(due, &navi->gen_credits);
+    napi_schedule(&navi->rq[0].napi);
+  }
+
+  return HRTIMER_RESTART;
+}
+
+/**
+ * @brief Show the airtime pacing state of a radio in debugfs.
+ *
+ * @param m Sequential file to print to.
+ * @param v Unused iterator value.
+ *
+ * @return Always 0.
+ */
+static int dummy_wifi_airtime_stats_show(struct seq_file *m, void *v) {
+  struct dummy_wifi_context *navi = m->private;
+  s64 backlog = atomic64_read(nvf_airtime_clock(navi)) - ktime_get_ns();
+
+  seq_printf(m, "link_rate_kbps: %u\n", READ_ONCE(navi->link_rate_kbps));
+  seq_printf(m, "backlog_ns: %lld\n", max_t(s64, backlog, 0));
+  seq_printf(m, "stops: %ld\n", atomic_long_read(&navi->tx_stops));
+
+  return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(dummy_wifi_airtime_stats);
+
+/**
+ * @brief Allocate the delay wheel of a radio, unless it already has one.
+ *
+ * The wheel is only needed once a delay is configured, and is kept until
+ * the radio is freed.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ *
+ * @return 0 on success, -ENOMEM on allocation failure.
+ */
+static int dummy_wifi_wheel_alloc(struct dummy_wifi_context *navi) {
+  struct nvf_wheel *w;
+
+  if (smp_load_acquire(&navi->wheel) != NULL) {
+    return 0;
+  }
+
+  w = kvzalloc(sizeof(*w), GFP_KERNEL);
+  if (w == NULL) {
+    return -ENOMEM;
+  }
+  spin_lock_init(&w->lock);
+  hrtimer_init(&w->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_SOFT);
+  w->timer.function = nvf_wheel_timer;
+  w->navi = navi;
+
+  // Concurrent writers: the first one wins.
+  if (cmpxchg_release(&navi->wheel, NULL, w) != NULL) {
+    kvfree(w);
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Set the delay or the jitter of the link of a radio.
+ *
+ * Their sum must fit on the delay wheel. It is checked and the value stored
+ * under the lock of the wheel, so concurrent writes of the delay and the
+ * jitter cannot both pass the check against the old value of the other.
+ *
+ * @param navi Pointer to the DummyWiFi context.
+ * @param field Delay or jitter to set.
+ * @param other The other one.
+ * @param val New value in microseconds.
+ *
+ * @return 0 on success, -ERANGE if the delay is too long, -ENOMEM if the
+ *         wheel could not be allocated.
+ */
+static int dummy_wifi_link_delay_set(struct dummy_wifi_context *navi,
+                                     u32 *field, const u32 *other, u64 val) {
+  struct nvf_wheel *w;
+  int err = 0;
+
+  // Lowering a value keeps the sum in range, no wheel is needed for 0.
+  if (val == 0) {
+    WRITE_ONCE(*field, 0);
+    return 0;
+  }
+  if (val > NVF_WHEEL_MAX_US) {
+    return -ERANGE;
+  }
+  if (dummy_wifi_wheel_alloc(navi)) {
+    return -ENOMEM;
+  }
+
+  w = smp_load_acquire(&navi->wheel);
+  spin_lock_bh(&w->lock);
+  if (val + READ_ONCE(*other) > NVF_WHEEL_MAX_US) {
+    err = -ERANGE;
+  } else {
+    WRITE_ONCE(*field, val);
+  }
+  spin_unlock_bh(&w->lock);
+
+  return err;
+}
+
+/**
+ * @brief Read the delay of the link of a radio.
+ *
+ * @param data Pointer to the DummyWiFi context.
+ * @param val Delay in microseconds.
+ *
+ * @return Always 0.
+ */
+static int dummy_wifi_link_delay_get(void *data, u64 *val) {
+  struct dummy_wifi_context *navi = data;
+
+  *val = READ_ONCE(navi->link_delay_us);
+
+  return 0;
+}
+
+/**
+ * @brief Set the delay of the link of a radio.
+ *
+ * @param data Pointer to the DummyWiFi context.
+ * @param val Delay in microseconds.
+ *
+ * @return See dummy_wifi_link_delay_set().
+ */
+static int dummy_wifi_link_delay_write(void *data, u64 val) {
+  struct dummy_wifi_context *navi = data;
+
+  return dummy_wifi_link_delay_set(navi, &navi->link_delay_us,
+                                   &navi->link_jitter_us, val);
+}
+DEFINE_DEBUGFS_ATTRIBUTE(dummy_wifi_link_delay_fops, dummy_wifi_link_delay_get,
+                         dummy_wifi_link_delay_write, "%llu\n");
+
+/**
+ * @brief Read the jitter of the link of a radio.
+ *
+ * @param data Pointer to the DummyWiFi context.
+ * @param val Jitter in microseconds.
+ *
+ * @return Always 0.
+ */
+static int dummy_wifi_link_jitter_get(void *data, u64 *val) {
+  struct dummy_wifi_context *navi = data;
+
+  *val = READ_ONCE(navi->link_jitter_us);
+
+  return 0;
+}
+
+/**
+ * @brief Set the jitter of the link of a radio.
+ *
+ * @param data Pointer to the DummyWiFi context.
+ * @param val Jitter in microseconds.
+ *
+ * @return See dummy_wifi_link_delay_set().
+ */
+static int dummy_wifi_link_jitter_write(void *data, u64 val) {
+  struct dummy_wifi_context *navi = data;
+
+  return dummy_wifi_link_delay_set(navi, &navi->link_jitter_us,
+                                   &navi->link_delay_us, val);
+}
+DEFINE_DEBUGFS_ATTRIBUTE(dummy_wifi_link_jitter_fops,
+                         dummy_wifi_link_jitter_get,
+                         dummy_wifi_link_jitter_write, "%llu\n");
+
+/**
+ * @brief Read the roaming threshold of a radio.
+ *
+ * @param data Pointer to the DummyWiFi context.
+ * @param val Threshold in dBm.
+ *
+ * @return Always 0.
+ */
+static int dummy_wifi_roam_threshold_get(void *data, u64 *val) {
+  struct dummy_wifi_context *navi = data;
+
+  *val = (s64)READ_ONCE(navi->roam_threshold);
+
+  return 0;
+}
+
+/**
+ * @brief Set the roaming threshold of a radio.
+ *
+ * @param data Pointer to the DummyWiFi context.
+ * @param val Threshold in dBm, 0 to disable the roaming policy.
+ *
+ * @return 0 on success, -ERANGE if the threshold is not a signal.
+ */
+static int dummy_wifi_roam_threshold_set(void *data, u64 val) {
+  struct dummy_wifi_context *navi = data;
+
+  if ((s64)val < -128 || (s64)val > 0) {
+    return -ERANGE;
+  }
+  WRITE_ONCE(navi->roam_threshold, (s64)val);
+
+  return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE_SIGNED(dummy_wifi_roam_threshold_fops,
+                                dummy_wifi_roam_threshold_get,
+                                dummy_wifi_roam_threshold_set, "%lld\n");
+
+/**
+ * @brief Show the statistics of the emulated link of a radio in debugfs.
+ *
+ * @param m Sequential file to print to.
+ * @param v Unused iterator value.
+ *
+ * @return Always 0.
+ */
+static int dummy_wifi_link_stats_show(struct seq_file *m, void *v) {
+  struct dummy_wifi_context *navi = m->private;
+  struct nvf_wheel *w = smp_load_acquire(&navi->wheel);
+
+  seq_printf(m, "lost: %ld\n", atomic_long_read(&navi->link_lost));
+  seq_printf(m, "delayed: %ld\n", atomic_long_read(&navi->link_delayed));
+  seq_printf(m, "reordered: %ld\n", atomic_long_read(&navi->link_reordered));
+  seq_printf(m, "queued: %u\n", w != NULL ? READ_ONCE(w->queued) : 0);
+
+  return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(dummy_wifi_link_stats);
+
+/**
+ * @brief Read the rate of the RX traffic generator.
+ *
+ * @param data Pointer to the DummyWiFi context.
+ * @param val Filled with the rate in frames per second.
+ *
+ * @return Always 0.
+ */
+static int dummy_wifi_gen_pps_get(void *data, u64 *val) {
+  struct dummy_wifi_context *navi = data;
+
+  *val = READ_ONCE(navi->gen_pps);
+
+  return 0;
+}
+
+/**
+ * @brief Set the rate of the RX traffic generator, 0 stops it.
+ *
+ * @param data Pointer to the DummyWiFi context.
+ * @param val Rate in frames per second.
+ *
+ * @return 0 on success, -EINVAL if the rate does not fit.
+ */
+static int dummy_wifi_gen_pps_set(void *data, u64 val) {
+  struct dummy_wifi_context *navi = data;
+
+  if (val > U32_MAX) {
+    return -EINVAL;
+  }
+
+  WRITE_ONCE(navi->gen_pps, val);
+  if (val) {
+    hrtimer_start(&navi->gen_timer, 0, HRTIMER_MODE_REL_SOFT);
+  } else {
+    hrtimer_cancel(&navi->gen_timer);
+  }
+
+  return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(dummy_wifi_gen_pps_fops, dummy_wifi_gen_pps_get,
+                         dummy_wifi_gen_pps_set, "%llu\n");
+
+/**
+ * @brief Show the statistics of the RX traffic generator in debugfs.
+ *
+ * @param m Sequential file to print to.
+ * @param v Unused iterator value.
+ *
+ * @return Always 0.
+ */
+static int dummy_wifi_gen_stats_show(struct seq_file *m, void *v) {
+  struct dummy_wifi_context *navi = m->private;
 
-  // Schedule a work item to perform the scan operation.
-  if (!schedule_work(&navi->ws_scan)) {
-    // If scheduling the work item fails (e.g., due to lack of resources),
-    // return an error.
-    return -EBUSY;
-  }
+  seq_printf(m, "packets: %llu\n", READ_ONCE(navi->gen_packets));
+  seq_printf(m, "overruns: %llu\n", READ_ONCE(navi->gen_overruns));
+  seq_printf(m, "credits: %d\n", atomic_read(&navi->gen_credits));
 
-  // Return 0 to indicate that the scan operation was successfully initiated.
-  return 0; /* OK */
+  return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(dummy_wifi_gen_stats);
 
 /**
- * @brief Connects a wireless device to a network.
+ * @brief Set up one receive queue of a radio.
  *
- * This function connects a wireless device to a network using the provided
- * parameters.
+ * The queue gets a ring fed by the peer, a NAPI context draining it and a
+ * page pool for the buffers of the frames built by the driver.
  *
- * @param wiphy The wireless PHY (physical layer) structure.
- * @param dev The network device structure.
- * @param sme The connection parameters including SSID.
+ * @param navi Pointer to the DummyWiFi context.
+ * @param rq Receive queue to set up.
  *
- * @return 0 on success, -ERESTARTSYS if interrupted by a signal,
- *         or -EBUSY if the connection work is already scheduled.
+ * @return 0 on success, a negative error code on failure.
  */
-static int nvf_connect(struct wiphy *wiphy, struct net_device *dev,
-                       struct cfg80211_connect_params *sme) {
-  // Get the DummyWiFi context associated with the wireless PHY.
-  struct dummy_wifi_context *navi = wiphy_get_navi_context(wiphy)->navi;
-
-  // Determine the length of the SSID, limited to 15 characters.
-  size_t ssid_len = sme->ssid_len > 15 ? 15 : sme->ssid_len;
+static int dummy_wifi_rq_setup(struct dummy_wifi_context *navi,
+                               struct dummy_wifi_rq *rq) {
+  struct page_pool_params pp_params = {
+      .order = 0,
+      .pool_size = NVF_RING_SIZE,
+      .nid = NUMA_NO_NODE,
+      .napi = &rq->napi, // Lockless recycling from our NAPI context.
+  };
+  int err;
 
-  // Attempt to acquire the semaphore with interruptible wait.
-  if (down_interruptible(&navi->sem)) {
-    // The semaphore acquisition was interrupted by a signal.
-    return -ERESTARTSYS;
+  if (ptr_ring_init(&rq->ring, NVF_RING_SIZE, GFP_KERNEL)) {
+    return -ENOMEM;
   }
+  netif_napi_add(navi->ndev, &rq->napi, nvf_napi_poll);
 
-  // Copy the SSID from the connection parameters to the DummyWiFi context.
-  // Ensure it is null-terminated.
-  memcpy(navi->connecting_ssid, sme->ssid, ssid_len);
-  navi->connecting_ssid[ssid_len] = 0;
-
-  // Release the semaphore.
-  up(&navi->sem);
+  rq->page_pool = page_pool_create(&pp_params);
+  if (IS_ERR(rq->page_pool)) {
+    err = PTR_ERR(rq->page_pool);
+    goto l_error_page_pool;
+  }
 
-  // Schedule the connection work to be performed asynchronously.
-  if (!schedule_work(&navi->ws_connect)) {
-    // The work is already scheduled or the scheduling failed.
-    return -EBUSY;
+  // XDP programs see the queue, and buffers return to its page pool.
+  err = xdp_rxq_info_reg(&rq->xdp_rxq, navi->ndev, rq - navi->rq,
+                         rq->napi.napi_id);
+  if (err) {
+    goto l_error_rxq;
+  }
+  err = xdp_rxq_info_reg_mem_model(&rq->xdp_rxq, MEM_TYPE_PAGE_POOL,
+                                   rq->page_pool);
+  if (err) {
+    goto l_error_mem_model;
   }
 
-  // The connection request was successfully initiated.
   return 0;
+
+l_error_mem_model:
+  xdp_rxq_info_unreg(&rq->xdp_rxq);
+l_error_rxq:
+  page_pool_destroy(rq->page_pool);
+l_error_page_pool:
+  netif_napi_del(&rq->napi);
+  ptr_ring_cleanup(&rq->ring, NULL);
+  return err;
 }
 
 /**
- * @brief Disconnect a wireless device from a Wi-Fi network.
+ * @brief Release one receive queue of a radio and the frames left on it.
  *
- * This function is used to disconnect a wireless device from a Wi-Fi network
- * by providing a reason code for the disconnection.
+ * Pages still held by the stack are returned to the page allocator when the
+ * frames are freed.
  *
- * @param wiphy Pointer to the wireless hardware (WiPHY) structure.
- * @param dev Pointer to the network device structure.
- * @param reason_code The reason code for the disconnection.
- * @return 0 on success, -ERESTARTSYS if interrupted by a signal, -EBUSY if work
- *         scheduling fails.
+ * @param rq Receive queue to release.
  */
-static int nvf_disconnect(struct wiphy *wiphy, struct net_device *dev,
-                          u16 reason_code) {
-  // Retrieve the DummyWiFi context associated with the provided wiphy
-  // structure.
-  struct dummy_wifi_context *navi = wiphy_get_navi_context(wiphy)->navi;
+static void dummy_wifi_rq_teardown(struct dummy_wifi_rq *rq) {
+  netif_napi_del(&rq->napi);
+  ptr_ring_cleanup(&rq->ring, nvf_ring_free);
+  xdp_rxq_info_unreg(&rq->xdp_rxq);
+  page_pool_destroy(rq->page_pool);
+}
+
+/**
+ * @brief Set up the receive queues of a radio.
+ *
+ * @param navi Pointer to the DummyWiFi context, n_queues must be set.
+ *
+ * @return 0 on success, a negative error code on failure.
+ */
+static int dummy_wifi_rq_init(struct dummy_wifi_context *navi) {
+  unsigned int i;
+  int err;
 
-  // Attempt to acquire a semaphore lock, allowing interruption by signals.
-  if (down_interruptible(&navi->sem)) {
-    return -ERESTARTSYS; // Return with error code if interrupted.
+  navi->rq = kvcalloc(navi->n_queues, sizeof(*navi->rq), GFP_KERNEL);
+  if (navi->rq == NULL) {
+    return -ENOMEM;
   }
 
-  // Set the disconnect reason code in the DummyWiFi context.
-  navi->disconnect_reason_code = reason_code;
+  for (i = 0; i < navi->n_queues; i++) {
+    err = dummy_wifi_rq_setup(navi, &navi->rq[i]);
+    if (err) {
+      goto l_error;
+    }
+  }
 
-  // Release the semaphore lock.
-  up(&navi->sem);
+  return 0;
 
-  // Schedule the disconnection work to be executed asynchronously.
-  if (!schedule_work(&navi->ws_disconnect)) {
-    return -EBUSY; // Return with an error code if scheduling fails.
+l_error:
+  while (i--) {
+    dummy_wifi_rq_teardown(&navi->rq[i]);
   }
-  return 0; // Return success status.
+  kvfree(navi->rq);
+  return err;
 }
 
 /**
- * @brief Structure for storing operations related to the cfg80211 subsystem.
- *
- * This structure defines a set of operations that can be performed on the
- * cfg80211 subsystem. These operations are typically implemented by a driver
- * or a module to interact with the wireless networking stack.
+ * @brief Release the receive queues of a radio and the frames left on them.
  *
- * Structure of functions for FullMAC 80211 drivers.
- * Functions that implemented along with fields/flags in wiphy structure would
- * represent drivers features. This DEMO can only perform "scan" and "connect".
- * Some functions cant be implemented alone, for example: with "connect" there
- * is should be function "disconnect".
+ * @param navi Pointer to the DummyWiFi context.
  */
-static struct cfg80211_ops nvf_cfg_ops = {
-    /**
-     * @brief Function pointer to the scan operation.
-     *
-     * This function is called when the cfg80211 subsystem needs to perform a
-     * Wi-Fi network scan. It should be implemented to initiate and handle the
-     * scanning process.
-     */
-    .scan = nvf_scan,
+static void dummy_wifi_rq_cleanup(struct dummy_wifi_context *navi) {
+  unsigned int i;
 
-    /**
-     * @brief Function pointer to the connect operation.
-     *
-     * This function is called when the cfg80211 subsystem needs to establish
-     * a connection to a Wi-Fi network. It should be implemented to handle the
-     * connection setup and management.
-     */
-    .connect = nvf_connect,
-
-    /**
-     * @brief Function pointer to the disconnect operation.
-     *
-     * This function is called when the cfg80211 subsystem needs to disconnect
-     * from a currently connected Wi-Fi network. It should be implemented to
-     * perform the necessary cleanup and disconnection steps.
-     */
-    .disconnect = nvf_disconnect,
-};
+  for (i = 0; i < navi->n_queues; i++) {
+    dummy_wifi_rq_teardown(&navi->rq[i]);
+  }
+  kvfree(navi->rq);
+}
 
 /**
- * @brief This function is the network device driver's start_xmit callback.
- *
- * It is called when the network stack wants to transmit a packet using
- * the specified network device. In this implementation, the function
- * simply frees the provided skb (socket buffer) since there is no
- * actual packet transmission happening. Note that the skb ownership
- * is transferred to this callback, so it is responsible for cleanup.
+ * @brief Release the medium rings of a radio and the frames left on them.
  *
- * @param skb Pointer to the socket buffer containing the packet to be
- * transmitted.
- * @param dev Pointer to the network device structure.
+ * The radio must be off the medium for an RCU grace period already.
  *
- * @return Returns NETDEV_TX_OK to indicate that the packet was successfully
- *         processed (even though no actual transmission occurred).
+ * @param navi Pointer to the DummyWiFi context.
  */
-static netdev_tx_t nvf_ndo_start_xmit(struct sk_buff *skb,
-                                      struct net_device *dev) {
-  /* Free the skb as its ownership has moved to the xmit callback. */
-  kfree_skb(skb);
+static void dummy_wifi_air_rings_free(struct dummy_wifi_context *navi) {
+  int cpu;
 
-  /* Indicate that the packet was successfully processed. */
-  return NETDEV_TX_OK;
+  if (navi->air_rings == NULL) {
+    return;
+  }
+
+  for_each_possible_cpu(cpu) {
+    ptr_ring_cleanup(per_cpu_ptr(navi->air_rings, cpu), nvf_ring_free);
+  }
+  free_percpu(navi->air_rings);
+  navi->air_rings = NULL;
 }
 
+#ifdef CONFIG_PAGE_POOL_STATS
 /**
- * @brief Network device operations structure for NVF driver
+ * @brief Show the page pool statistics of a radio in debugfs.
  *
- * This structure defines the network device operations for the NVF driver.
- * It specifies functions that should be implemented to handle various network
- * device tasks.
- * Structure of functions for network devices. It should have at least
- * ndo_start_xmit functions that called for packet to be sent.
- */
-static struct net_device_ops nvf_ndev_ops = {
-    /**
-     * @brief Start transmission of a network packet
-     *
-     * This function is responsible for initiating the transmission of a network
-     * packet. It is part of the network device operations and is called when
-     * the network device needs to send a packet.
-     *
-     * @param skb Pointer to the network packet to be transmitted.
-     * @param dev Pointer to the network device.
-     * @return 0 on success, an error code on failure.
-     */
-    .ndo_start_xmit = nvf_ndo_start_xmit,
-};
-
-/**
- * @brief Structure to represent a supported 2.4 GHz Wi-Fi channel.
+ * The statistics of the receive queues are summed up. A high share of
+ * recycled pages ("recycle_cached", "recycle_ring") against slow allocations
+ * means the receive path does not hit the page allocator.
+ *
+ * @param m Sequential file to print to.
+ * @param v Unused iterator value.
  *
- * This structure holds information about a 2.4 GHz Wi-Fi channel that is
- * supported by a device.
+ * @return Always 0.
  */
-static struct ieee80211_channel nvf_supported_channels_2ghz[] = {{
-    /**
-     * @brief The band to which the channel belongs.
-     *
-     * This field specifies that the channel belongs to the 2.4 GHz band.
-     * NL80211_BAND_2GHZ is a constant representing the 2.4 GHz band.
-     */
-    .band = NL80211_BAND_2GHZ,
+static int dummy_wifi_page_pool_show(struct seq_file *m, void *v) {
+  struct dummy_wifi_context *navi = m->private;
+  struct page_pool_stats stats = {};
+  unsigned int i;
 
-    /**
-     * @brief Hardware-specific value for the channel.
-     *
-     * This field represents a hardware-specific value associated with the
-     * channel. In this case, the channel is assigned the value 6.
-     */
-    .hw_value = 6,
+  for (i = 0; i < navi->n_queues; i++) {
+    page_pool_get_stats(navi->rq[i].page_pool, &stats);
+  }
 
-    /**
-     * @brief The center frequency of the channel in megahertz (MHz).
-     *
-     * This field specifies the center frequency of the channel in megahertz.
-     * For this channel, it is set to 2437 MHz, which corresponds to channel 6
-     * in the 2.4 GHz band.
-     */
-    .center_freq = 2437,
-}};
+  seq_printf(m, "alloc_fast: %llu\n", stats.alloc_stats.fast);
+  seq_printf(m, "alloc_slow: %llu\n", stats.alloc_stats.slow);
+  seq_printf(m, "alloc_slow_high_order: %llu\n",
+             stats.alloc_stats.slow_high_order);
+  seq_printf(m, "alloc_empty: %llu\n", stats.alloc_stats.empty);
+  seq_printf(m, "alloc_refill: %llu\n", stats.alloc_stats.refill);
+  seq_printf(m, "alloc_waive: %llu\n", stats.alloc_stats.waive);
+  seq_printf(m, "recycle_cached: %llu\n", stats.recycle_stats.cached);
+  seq_printf(m, "recycle_cache_full: %llu\n", stats.recycle_stats.cache_full);
+  seq_printf(m, "recycle_ring: %llu\n", stats.recycle_stats.ring);
+  seq_printf(m, "recycle_ring_full: %llu\n", stats.recycle_stats.ring_full);
+  seq_printf(m, "recycle_released_refcnt: %llu\n",
+             stats.recycle_stats.released_refcnt);
+
+  return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(dummy_wifi_page_pool);
+#endif
 
 /**
- * @brief An array of supported IEEE 802.11 rates for 2.4GHz frequency band.
+ * @brief Spread the transmit queues of a radio over the online CPUs (XPS).
  *
- * This array defines the supported rates for the 2.4GHz frequency band in a
- * structured format using a C array of structures.
- */
-static struct ieee80211_rate nvf_supported_rates_2ghz[] = {
-    {
-        .bitrate = 10,   /**< Bitrate in Mbps for the rate (10 Mbps). */
-        .hw_value = 0x1, /**< Hardware-specific value (0x1). */
-    },
-    {
-        .bitrate = 20,   /**< Bitrate in Mbps for the rate (20 Mbps). */
-        .hw_value = 0x2, /**< Hardware-specific value (0x2). */
-    },
-    {
-        .bitrate = 55,   /**< Bitrate in Mbps for the rate (55 Mbps). */
-        .hw_value = 0x4, /**< Hardware-specific value (0x4). */
-    },
-    {
-        .bitrate = 110,  /**< Bitrate in Mbps for the rate (110 Mbps). */
-        .hw_value = 0x8, /**< Hardware-specific value (0x8). */
-    }};
-
-/**
- * @brief Data structure for representing the IEEE 802.11 supported band for
- * the 2.4 GHz frequency range.
- *
- * This structure defines the capabilities and characteristics of the 2.4 GHz
- * band for IEEE 802.11 wireless networking.
+ * Queue N is used by every CPU whose rank among the online CPUs is N modulo
+ * the number of queues, so with one queue per CPU each CPU transmits on its
+ * own queue. Failures only cost performance and are ignored.
+ *
+ * @param navi Pointer to the DummyWiFi context.
  */
-static struct ieee80211_supported_band nf_band_2ghz = {
-    .ht_cap.cap = IEEE80211_HT_CAP_SGI_20, /* Set the Short Guard Interval (SGI)
-                                              capability to 20 MHz width. */
-    .ht_cap.ht_supported =
-        false, /* Indicate that HT (High Throughput) is not supported. */
-
-    .channels = nvf_supported_channels_2ghz, /* Store the array of supported
-                                                channels for 2.4 GHz band. */
-    .n_channels =
-        ARRAY_SIZE(nvf_supported_channels_2ghz), /* Store the number of
-                                                    supported channels. */
-
-    .bitrates = nvf_supported_rates_2ghz, /* Store the array of supported bit
-                                             rates for 2.4 GHz band. */
-    .n_bitrates =
-        ARRAY_SIZE(nvf_supported_rates_2ghz), /* Store the number of supported
-                                                 bit rates. */
-};
+static void dummy_wifi_set_xps(struct dummy_wifi_context *navi) {
+  cpumask_var_t mask;
+  unsigned int i, rank, cpu;
+
+  if (!zalloc_cpumask_var(&mask, GFP_KERNEL)) {
+    return;
+  }
+
+  for (i = 0; i < navi->n_queues; i++) {
+    cpumask_clear(mask);
+    rank = 0;
+    for_each_online_cpu(cpu) {
+      if (rank++ % navi->n_queues == i) {
+        cpumask_set_cpu(cpu, mask);
+      }
+    }
+    netif_set_xps_queue(navi->ndev, mask, i);
+  }
+
+  free_cpumask_var(mask);
+}
 
 /**
  * @brief Create a new dummy context.
@@ -631,23 +6009,73 @@ static struct ieee80211_supported_band nf_band_2ghz = {
  * wiphy/net_device/wireless_dev is basic interfaces for the kernel to interact
  * with driver as wireless one. It returns driver's main "dummy" context.
  *
+ * @param idx Index of the radio. The first radio keeps the plain WIPHY_NAME,
+ *            the following ones get the index appended to it.
+ *
  * @return A pointer to the newly created dummy context, or NULL on failure.
  */
-static struct dummy_wifi_context *dummy_wifi_create_context(void) {
+static struct dummy_wifi_context *dummy_wifi_create_context(unsigned int idx) {
   struct dummy_wifi_context *ret = NULL;
   struct dummy_wifi_wiphy_priv_context *wiphy_data = NULL;
   struct dummy_wifi_ndev_priv_context *ndev_data = NULL;
+  struct dentry *airtime_dir, *link_dir, *roam_dir;
+  enum nl80211_band band;
+  char name[sizeof(WIPHY_NAME) + 10];
 
   /* Allocate memory for the dummy context */
-  ret = kmalloc(sizeof(*ret), GFP_KERNEL);
+  ret = kzalloc(sizeof(*ret), GFP_KERNEL);
   if (!ret) {
     goto l_error;
   }
+  ret->idx = idx;
+
+  /* Radios start idle and not scanning. */
+  atomic_set(&ret->state, DUMMY_WIFI_LINK_IDLE);
+
+  /* Radios start with the default BSS database. */
+  mutex_init(&ret->bss_lock);
+  mutex_init(&ret->link_lock);
+  kref_get(&dummy_wifi_default_bss->kref);
+  RCU_INIT_POINTER(ret->bss_table, dummy_wifi_default_bss);
+  ret->bss_refresh_at = jiffies;
+
+  /* Initialize workqueue items for various Wi-Fi routines. They must be ready
+   * before registration, as cfg80211 may call our ops right away. */
+  INIT_WORK(&ret->ws_connect, dummy_wifi_connect_routine);
+  INIT_WORK(&ret->ws_disconnect, dummy_wifi_disconnect_routine);
+  INIT_WORK(&ret->ws_scan, dummy_wifi_scan_routine);
+  INIT_DELAYED_WORK(&ret->ws_sched_scan, dummy_wifi_sched_scan_routine);
+  INIT_WORK(&ret->ws_roam, dummy_wifi_roam_routine);
+
+  /* Initialize the timer emulating the scan dwell time. */
+  hrtimer_init(&ret->scan_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+  ret->scan_timer.function = dummy_wifi_scan_timer;
+  ret->scan_dwell_us = READ_ONCE(scan_dwell_us);
+  ret->roam_threshold = clamp(READ_ONCE(roam_threshold), -128, 0);
+  ret->roam_hysteresis = READ_ONCE(roam_hysteresis);
+
+  /* Initialize the RX traffic generator, off until a rate is set. */
+  hrtimer_init(&ret->gen_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+  ret->gen_timer.function = dummy_wifi_gen_timer;
+  ret->gen_size = ETH_ZLEN;
+  ret->gen_flows = 1;
+  ret->gen_burst = 32;
+
+  /* Initialize airtime pacing, see nvf_ndo_start_xmit(). */
+  hrtimer_init(&ret->tx_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+  ret->tx_timer.function = dummy_wifi_tx_timer;
+  ret->airtime = READ_ONCE(airtime);
+  ret->tx_burst_us = 2000;
 
   /* Allocate memory for the wiphy context, representing a wireless device.
    * This context is used for communication with the wireless subsystem. */
+  if (idx == 0) {
+    strscpy(name, WIPHY_NAME, sizeof(name));
+  } else {
+    snprintf(name, sizeof(name), WIPHY_NAME "%u", idx);
+  }
   ret->wiphy = wiphy_new_nm(
-      &nvf_cfg_ops, sizeof(struct dummy_wifi_wiphy_priv_context), WIPHY_NAME);
+      &nvf_cfg_ops, sizeof(struct dummy_wifi_wiphy_priv_context), name);
   if (ret->wiphy == NULL) {
     goto l_error_wiphy;
   }
@@ -657,30 +6085,82 @@ static struct dummy_wifi_context *dummy_wifi_create_context(void) {
   wiphy_data->navi = ret;
 
   /* Set the device object as wiphy "parent." This is typically a physical
-   * device. Uncomment this line if you have a device object available. */
-  /* set_wiphy_dev(ret->wiphy, dev); */
+   * device; all radios share the platform device of the module. */
+  set_wiphy_dev(ret->wiphy, &dummy_wifi_pdev->dev);
 
   /* Set the supported interface mode for the wiphy context. In this case, it's
    * NL80211_IFTYPE_STATION (station mode). */
   ret->wiphy->interface_modes = BIT(NL80211_IFTYPE_STATION);
 
-  /* Define the supported frequency bands for the wireless device.
-   * In this example, we use only the 2.4 GHz band (NL80211_BAND_2GHZ).
-   * You can add other bands as needed. */
-  ret->wiphy->bands[NL80211_BAND_2GHZ] = &nf_band_2ghz;
+  /* Define the supported frequency bands for the wireless device: 2.4, 5
+   * and 6 GHz, see nvf_bands. */
+  for (band = 0; band < NUM_NL80211_BANDS; band++) {
+    ret->wiphy->bands[band] = nvf_bands[band];
+  }
+
+  /* Report signal strengths of the access points in mBm. */
+  ret->wiphy->signal_type = CFG80211_SIGNAL_TYPE_MBM;
 
   /* Set the maximum number of SSIDs that can be scanned for. */
   ret->wiphy->max_scan_ssids = 69;
 
+  /* Support one scheduled scan at a time, filtered by match sets. */
+  ret->wiphy->max_sched_scan_reqs = 1;
+  ret->wiphy->max_sched_scan_ssids = NVF_SCHED_SCAN_MAX_MATCH;
+  ret->wiphy->max_match_sets = NVF_SCHED_SCAN_MAX_MATCH;
+  ret->wiphy->max_sched_scan_plans = NVF_SCHED_SCAN_MAX_PLANS;
+  ret->wiphy->max_sched_scan_plan_interval = NVF_SCHED_SCAN_MAX_INTERVAL;
+  ret->wiphy->max_sched_scan_plan_iterations = U16_MAX;
+
   /* Register the wiphy context. After this, a new wireless device should be
    * visible in the system. You can check with: $ iw list Wiphy dummy */
   if (wiphy_register(ret->wiphy) < 0) {
     goto l_error_wiphy_register;
   }
 
-  /* Allocate network device context. */
-  ret->ndev =
-      alloc_netdev(sizeof(*ndev_data), NDEV_NAME, NET_NAME_ENUM, ether_setup);
+  /* Expose the radio state next to the cfg80211 debugfs entries of the wiphy,
+   * e.g. /sys/kernel/debug/ieee80211/dummy/state. They are removed together
+   * with the wiphy. */
+  debugfs_create_file("state", 0444, ret->wiphy->debugfsdir, ret,
+                      &dummy_wifi_state_fops);
+  debugfs_create_u32("scan_dwell_us", 0644, ret->wiphy->debugfsdir,
+                     &ret->scan_dwell_us);
+  debugfs_create_file("bss", 0644, ret->wiphy->debugfsdir, ret,
+                      &dummy_wifi_bss_fops);
+  debugfs_create_file("bss_ctl", 0644, ret->wiphy->debugfsdir, ret,
+                      &dummy_wifi_bss_ctl_fops);
+  debugfs_create_file("scan_stats", 0444, ret->wiphy->debugfsdir, ret,
+                      &dummy_wifi_scan_stats_fops);
+  debugfs_create_file("latency", 0444, ret->wiphy->debugfsdir, ret,
+                      &dummy_wifi_latency_fops);
+  airtime_dir = debugfs_create_dir("airtime", ret->wiphy->debugfsdir);
+  debugfs_create_bool("enable", 0644, airtime_dir, &ret->airtime);
+  debugfs_create_u32("rate_kbps", 0644, airtime_dir, &ret->tx_rate_kbps);
+  debugfs_create_u32("burst_us", 0644, airtime_dir, &ret->tx_burst_us);
+  debugfs_create_u32("overhead_us", 0644, airtime_dir, &ret->tx_overhead_us);
+  debugfs_create_file("stats", 0444, airtime_dir, ret,
+                      &dummy_wifi_airtime_stats_fops);
+  link_dir = debugfs_create_dir("link", ret->wiphy->debugfsdir);
+  debugfs_create_u32("loss_ppm", 0644, link_dir, &ret->link_loss_ppm);
+  debugfs_create_u32("reorder_ppm", 0644, link_dir, &ret->link_reorder_ppm);
+  debugfs_create_file_unsafe("delay_us", 0644, link_dir, ret,
+                             &dummy_wifi_link_delay_fops);
+  debugfs_create_file_unsafe("jitter_us", 0644, link_dir, ret,
+                             &dummy_wifi_link_jitter_fops);
+  debugfs_create_file("stats", 0444, link_dir, ret,
+                      &dummy_wifi_link_stats_fops);
+  roam_dir = debugfs_create_dir("roam", ret->wiphy->debugfsdir);
+  debugfs_create_file_unsafe("threshold_dbm", 0644, roam_dir, ret,
+                             &dummy_wifi_roam_threshold_fops);
+  debugfs_create_u32("hysteresis_db", 0644, roam_dir, &ret->roam_hysteresis);
+  debugfs_create_file("trigger", 0200, roam_dir, ret, &dummy_wifi_roam_fops);
+
+  /* Allocate network device context, with one transmit and one receive queue
+   * per CPU unless the "queues" parameter says otherwise. */
+  ret->n_queues = min_t(unsigned int, queues ?: num_online_cpus(),
+                        NVF_MAX_QUEUES);
+  ret->ndev = alloc_netdev_mqs(sizeof(*ndev_data), NDEV_NAME, NET_NAME_ENUM,
+                               ether_setup, ret->n_queues, ret->n_queues);
   if (ret->ndev == NULL) {
     goto l_error_alloc_ndev;
   }
@@ -696,14 +6176,43 @@ static struct dummy_wifi_context *dummy_wifi_create_context(void) {
   ndev_data->wdev.iftype = NL80211_IFTYPE_STATION;
   ret->ndev->ieee80211_ptr = &ndev_data->wdev;
 
-  /* Set the device object for the net_device. Uncomment this line if you have
-   * a device object available. */
-  /* SET_NETDEV_DEV(ret->ndev, wiphy_dev(ret->wiphy)); */
+  /* Set the device object for the net_device, AF_XDP pools are DMA mapped
+   * against it. */
+  SET_NETDEV_DEV(ret->ndev, wiphy_dev(ret->wiphy));
 
   /* Set network device hooks, such as ndo_start_xmit(). */
   ret->ndev->netdev_ops = &nvf_ndev_ops;
 
-  /* Add proper net_device initialization here. */
+  /* Give the interface a locally administered MAC address, so frames looped
+   * back through the peer are classified as PACKET_HOST. */
+  eth_hw_addr_random(ret->ndev);
+
+  /* Advertise scatter-gather, checksum and segmentation offloads, so the stack
+   * hands over large frames with partial checksums. They can be toggled with
+   * ethtool -K. */
+  ret->ndev->features |= NVF_NETDEV_FEATURES;
+  ret->ndev->hw_features |= NVF_NETDEV_FEATURES;
+  ret->ndev->vlan_features |= NVF_NETDEV_FEATURES;
+
+  /* Native XDP on the receive queues, redirect target and AF_XDP. */
+  ret->ndev->xdp_features = NETDEV_XDP_ACT_BASIC | NETDEV_XDP_ACT_REDIRECT |
+                            NETDEV_XDP_ACT_NDO_XMIT |
+                            NETDEV_XDP_ACT_XSK_ZEROCOPY;
+
+  /* Set up the receive queues: a ring fed by the peer and a NAPI context
+   * draining it, per queue. */
+  if (dummy_wifi_rq_init(ret)) {
+    goto l_error_ring;
+  }
+
+  /* Allocate the per-CPU interface statistics. */
+  ret->stats = netdev_alloc_pcpu_stats(struct dummy_wifi_stats);
+  if (ret->stats == NULL) {
+    goto l_error_stats;
+  }
+
+  /* Without a dedicated peer, frames are looped back to this device. */
+  RCU_INIT_POINTER(ret->peer, ret);
 
   /* Register the network device. After this, a new network device should be
    * visible with: $ ip a */
@@ -711,106 +6220,400 @@ static struct dummy_wifi_context *dummy_wifi_create_context(void) {
     goto l_error_ndev_register;
   }
 
+  /* Let each CPU transmit on its own queue. */
+  dummy_wifi_set_xps(ret);
+
+  /* Expose the RX traffic generator, e.g.
+   * /sys/kernel/debug/ieee80211/dummy/rxgen/pps. Only now, as it feeds the
+   * receive queues. */
+  ret->gen_dir = debugfs_create_dir("rxgen", ret->wiphy->debugfsdir);
+  debugfs_create_file_unsafe("pps", 0644, ret->gen_dir, ret,
+                             &dummy_wifi_gen_pps_fops);
+  debugfs_create_u32("size", 0644, ret->gen_dir, &ret->gen_size);
+  debugfs_create_u32("flows", 0644, ret->gen_dir, &ret->gen_flows);
+  debugfs_create_u32("burst", 0644, ret->gen_dir, &ret->gen_burst);
+  debugfs_create_file("stats", 0444, ret->gen_dir, ret,
+                      &dummy_wifi_gen_stats_fops);
+
+#ifdef CONFIG_PAGE_POOL_STATS
+  /* Expose the recycling statistics of the receive buffers. */
+  ret->pp_stats = debugfs_create_file("page_pool", 0444, ret->wiphy->debugfsdir,
+                                      ret, &dummy_wifi_page_pool_fops);
+#endif
+
   return ret;
 
 l_error_ndev_register:
+  free_percpu(ret->stats);
+l_error_stats:
+  dummy_wifi_rq_cleanup(ret);
+l_error_ring:
   free_netdev(ret->ndev);
 l_error_alloc_ndev:
   wiphy_unregister(ret->wiphy);
 l_error_wiphy_register:
   wiphy_free(ret->wiphy);
 l_error_wiphy:
+  dummy_wifi_bss_table_put(rcu_dereference_protected(ret->bss_table, 1));
+  kvfree(ret->wheel);
   kfree(ret);
 l_error:
   return NULL;
 }
 
 /**
- * @brief Free the resources associated with a dummy context.
+ * @brief Free the resources associated with a list of dummy contexts.
  *
  * This function is responsible for releasing the memory and resources
- * associated with a dummy context. It performs the following actions:
+ * associated with dummy contexts. It performs the following actions:
  *
- * 1. Checks if the context pointer is not NULL to avoid dereferencing a
- *    null pointer.
- * 2. Unregisters the network device (netdev) associated with the context.
- * 3. Frees the network device.
- * 4. Unregisters the wireless PHY (wiphy) associated with the context.
- * 5. Frees the wireless PHY.
- * 6. Finally, deallocates the memory used by the dummy context itself.
+ * 1. Reports the scans in progress as aborted, and detaches the peers, so
+ *    that no new frames are queued to the devices.
+ * 2. Unregisters all network devices (netdev) in a single RTNL section, which
+ *    lets the kernel wait for in-flight users once for the whole batch.
+ * 3. Makes sure that no work is queued for the workqueue items, and detaches
+ *    the radios from the shared media.
+ * 4. Releases the receive queues and unregisters the wireless PHYs (wiphy).
+ * 5. Frees the network devices, the wireless PHYs and the contexts. The delay
+ *    wheels were emptied when the devices went down.
  *
- * @param ctx Pointer to the dummy context to be freed.
+ * @param head List of contexts to be freed, linked through their list entry.
  */
-static void dummy_wifi_free(struct dummy_wifi_context *ctx) {
-  // Check if the context pointer is NULL to avoid dereferencing a null pointer.
-  if (ctx == NULL) {
-    return;
+static void dummy_wifi_free_many(struct list_head *head) {
+  struct dummy_wifi_context *ctx, *tmp;
+  LIST_HEAD(kill_list);
+
+  // Detach the peers and queue the network devices for unregistration. The
+  // scans in progress are reported first, cfg80211 frees their requests
+  // when the devices go down.
+  rtnl_lock();
+  list_for_each_entry(ctx, head, list) {
+    dummy_wifi_scan_stop(ctx);
+    RCU_INIT_POINTER(ctx->peer, NULL);
+    unregister_netdevice_queue(ctx->ndev, &kill_list);
+  }
+  unregister_netdevice_many(&kill_list);
+  rtnl_unlock();
+
+  list_for_each_entry(ctx, head, list) {
+    // Stop the RX traffic generator; removing its files first makes sure no
+    // write restarts it. Same for the readers of the receive queues.
+    debugfs_remove(ctx->gen_dir);
+    debugfs_remove(ctx->pp_stats);
+    hrtimer_cancel(&ctx->gen_timer);
+
+    // Likewise, no roam can be triggered once the roam files are gone.
+    debugfs_lookup_and_remove("roam", ctx->wiphy->debugfsdir);
+
+    // No cfg80211 op can reach us via the netdev anymore, flush the work.
+    hrtimer_cancel(&ctx->tx_timer);
+    hrtimer_cancel(&ctx->scan_timer);
+    cancel_work_sync(&ctx->ws_connect);
+    cancel_work_sync(&ctx->ws_disconnect);
+    cancel_work_sync(&ctx->ws_roam);
+    cancel_work_sync(&ctx->ws_scan);
+    cancel_delayed_work_sync(&ctx->ws_sched_scan);
+
+    // No connection can attach the radio to a shared medium anymore.
+    dummy_wifi_air_detach(ctx);
+  }
+
+  // Radios on a shared medium may still be delivering to the detached ones.
+  synchronize_rcu();
+
+  list_for_each_entry_safe(ctx, tmp, head, list) {
+    // Release the NAPI contexts and the frames left on the receive rings.
+    dummy_wifi_rq_cleanup(ctx);
+    dummy_wifi_air_rings_free(ctx);
+    free_percpu(ctx->stats);
+
+    // Unregister the wireless PHY (wiphy) associated with the context.
+    wiphy_unregister(ctx->wiphy);
+
+    // Free the network device, the wireless PHY and the BSS database.
+    free_netdev(ctx->ndev);
+    wiphy_free(ctx->wiphy);
+    dummy_wifi_bss_table_put(rcu_dereference_protected(ctx->bss_table, 1));
+    dummy_wifi_bss_table_put(ctx->bss_reported);
+    kvfree(ctx->sched_scan_gens);
+    kvfree(ctx->wheel);
+
+    // Deallocate the memory used by the dummy context itself.
+    list_del(&ctx->list);
+    kfree(ctx);
+  }
+}
+
+/**
+ * @brief Change the device receiving the frames transmitted by a radio.
+ *
+ * The offloads of the radio depend on the XDP program of its peer, see
+ * nvf_ndo_fix_features().
+ *
+ * @param ctx Pointer to the DummyWiFi context of the radio.
+ * @param peer New peer.
+ */
+static void dummy_wifi_set_peer(struct dummy_wifi_context *ctx,
+                                struct dummy_wifi_context *peer) {
+  rtnl_lock();
+  rcu_assign_pointer(ctx->peer, peer);
+  netdev_update_features(ctx->ndev);
+  rtnl_unlock();
+}
+
+/**
+ * @brief Grow or shrink the set of radios to the requested count.
+ *
+ * New radios are appended at the tail. Radios are paired two by two (0 with
+ * 1, 2 with 3, ...) so that frames transmitted on one interface are received
+ * on the other; a radio without a partner loops frames back to itself.
+ * Radios are removed from the tail, and a survivor whose partner is removed
+ * falls back to loopback. Must be called with dummy_wifi_radios_lock held.
+ *
+ * @param count Requested number of radios.
+ *
+ * @return 0 on success, -ENOMEM if a radio could not be created. On failure
+ *         the radios created so far are kept.
+ */
+static int dummy_wifi_set_radio_count(unsigned int count) {
+  struct dummy_wifi_context *ctx, *partner;
+  LIST_HEAD(doomed);
+
+  lockdep_assert_held(&dummy_wifi_radios_lock);
+
+  while (dummy_wifi_n_radios < count) {
+    ctx = dummy_wifi_create_context(dummy_wifi_n_radios);
+    if (ctx == NULL) {
+      return -ENOMEM;
+    }
+
+    // Odd radios are paired with the previous (even) one.
+    if (ctx->idx % 2) {
+      partner = list_last_entry(&dummy_wifi_radios, struct dummy_wifi_context,
+                                list);
+      dummy_wifi_set_peer(ctx, partner);
+      dummy_wifi_set_peer(partner, ctx);
+    }
+
+    list_add_tail(&ctx->list, &dummy_wifi_radios);
+    dummy_wifi_n_radios++;
+  }
+
+  if (dummy_wifi_n_radios == count) {
+    return 0;
+  }
+
+  while (dummy_wifi_n_radios > count) {
+    ctx = list_last_entry(&dummy_wifi_radios, struct dummy_wifi_context, list);
+    list_move(&ctx->list, &doomed);
+    dummy_wifi_n_radios--;
+  }
+
+  // A survivor with an even index just lost its partner: loop back.
+  if (!list_empty(&dummy_wifi_radios)) {
+    ctx = list_last_entry(&dummy_wifi_radios, struct dummy_wifi_context, list);
+    if (ctx->idx % 2 == 0) {
+      dummy_wifi_set_peer(ctx, ctx);
+    }
+  }
+
+  dummy_wifi_free_many(&doomed);
+  return 0;
+}
+
+/**
+ * @brief Setter of the "radios" module parameter.
+ *
+ * At load time the value is only recorded, the radios are created by the
+ * module initialization. Afterwards, writing to
+ * /sys/module/dummywifi/parameters/radios adds or removes radios at runtime.
+ *
+ * @param val String written to the parameter.
+ * @param kp Kernel parameter descriptor.
+ *
+ * @return 0 on success, a negative error code otherwise.
+ */
+static int dummy_wifi_radios_param_set(const char *val,
+                                       const struct kernel_param *kp) {
+  unsigned int count;
+  int err = kstrtouint(val, 0, &count);
+
+  if (err) {
+    return err;
+  }
+  if (count > NVF_MAX_RADIOS) {
+    return -EINVAL;
+  }
+
+  mutex_lock(&dummy_wifi_radios_lock);
+  if (dummy_wifi_ready) {
+    err = dummy_wifi_set_radio_count(count);
+    *(unsigned int *)kp->arg = dummy_wifi_n_radios;
+  } else {
+    *(unsigned int *)kp->arg = count;
   }
+  mutex_unlock(&dummy_wifi_radios_lock);
+
+  return err;
+}
+
+static const struct kernel_param_ops dummy_wifi_radios_param_ops = {
+    .set = dummy_wifi_radios_param_set,
+    .get = param_get_uint,
+};
 
-  // Unregister the network device (netdev) associated with the context.
-  unregister_netdev(ctx->ndev);
+/**
+ * @brief radios: Number of radios (wiphy + netdev pairs) to emulate.
+ */
+static unsigned int radios = 1;
+module_param_cb(radios, &dummy_wifi_radios_param_ops, &radios, 0644);
+MODULE_PARM_DESC(radios, "Number of emulated radios, writable at runtime "
+                         "(default: 1, max: " __stringify(NVF_MAX_RADIOS) ")");
 
-  // Free the network device.
-  free_netdev(ctx->ndev);
+/**
+ * @brief Setter of the "roam_all" module parameter.
+ *
+ * Writing to /sys/module/dummywifi/parameters/roam_all asks every connected
+ * radio to roam at once, e.g. to emulate a roam storm. See
+ * dummy_wifi_roam_parse() for the accepted values.
+ *
+ * @param val String written to the parameter.
+ * @param kp Kernel parameter descriptor.
+ *
+ * @return 0 on success, a negative error code otherwise.
+ */
+static int dummy_wifi_roam_all_param_set(const char *val,
+                                         const struct kernel_param *kp) {
+  struct dummy_wifi_context *navi;
+  u64 req;
+  int err = dummy_wifi_roam_parse(val, &req);
 
-  // Unregister the wireless PHY (wiphy) associated with the context.
-  wiphy_unregister(ctx->wiphy);
+  if (err) {
+    return err;
+  }
 
-  // Free the wireless PHY.
-  wiphy_free(ctx->wiphy);
+  mutex_lock(&dummy_wifi_radios_lock);
+  list_for_each_entry(navi, &dummy_wifi_radios, list) {
+    if ((atomic_read(&navi->state) & DUMMY_WIFI_LINK_MASK) ==
+        DUMMY_WIFI_LINK_CONNECTED) {
+      dummy_wifi_roam_request(navi, req);
+    }
+  }
+  mutex_unlock(&dummy_wifi_radios_lock);
 
-  // Deallocate the memory used by the dummy context itself.
-  kfree(ctx);
+  return 0;
 }
 
+static const struct kernel_param_ops dummy_wifi_roam_all_param_ops = {
+    .set = dummy_wifi_roam_all_param_set,
+};
+
+/**
+ * @brief roam_all: Write-only trigger making all connected radios roam.
+ */
+module_param_cb(roam_all, &dummy_wifi_roam_all_param_ops, NULL, 0200);
+MODULE_PARM_DESC(roam_all, "Write \"next\", \"auto\" or a BSSID to make "
+                           "every connected radio roam");
+
 /**
  * @brief Module initialization function.
  *
  * This function initializes the virtual Wi-Fi module.
- * - It creates a context structure and initializes it with default values.
- * - Initializes the synchronization semaphore.
- * - Initializes workqueue items for connection, disconnection, and scanning
- * routines.
+ * - It allocates the workqueue shared by all radios.
+ * - It registers the platform device the radios are children of.
+ * - It loads or generates the default BSS database.
+ * - It creates the number of radios requested by the "radios" parameter.
+ * - Every radio gets its own context with its state machine and
+ *   workqueue items for connection, disconnection, and scanning routines.
  *
- * @return 0 if initialization is successful, -1 otherwise.
+ * @return 0 if initialization is successful, a negative error code otherwise.
  */
 static int __init virtual_wifi_init(void) {
-  g_ctx = dummy_wifi_create_context();
+  LIST_HEAD(doomed);
+  int err;
 
-  if (g_ctx != NULL) {
-    /* Initialize the synchronization semaphore with an initial value of 1. */
-    sema_init(&g_ctx->sem, 1);
+  nvf_bands_init();
+  nvf_air_init();
+
+  /* Allocate the workqueue executing the control operations of all radios. */
+  dummy_wifi_wq =
+      alloc_workqueue("dummywifi", WQ_UNBOUND | (wq_highpri ? WQ_HIGHPRI : 0),
+                      wq_max_active);
+  if (dummy_wifi_wq == NULL) {
+    return -ENOMEM;
+  }
+
+  /* Create the parent device of the radios, able to map AF_XDP pools. */
+  dummy_wifi_pdev = platform_device_register_simple(KBUILD_MODNAME,
+                                                    PLATFORM_DEVID_NONE,
+                                                    NULL, 0);
+  if (IS_ERR(dummy_wifi_pdev)) {
+    destroy_workqueue(dummy_wifi_wq);
+    return PTR_ERR(dummy_wifi_pdev);
+  }
+  err = dma_coerce_mask_and_coherent(&dummy_wifi_pdev->dev,
+                                     DMA_BIT_MASK(64));
+  if (err) {
+    goto l_error_pdev;
+  }
 
-    /* Initialize workqueue items for various Wi-Fi routines. */
-    INIT_WORK(&g_ctx->ws_connect, dummy_wifi_connect_routine);
-    g_ctx->connecting_ssid[0] = 0; // Clear the connecting SSID.
+  /* Build the BSS database given to the radios. */
+  if (bss_firmware != NULL) {
+    dummy_wifi_default_bss = dummy_wifi_bss_table_load(bss_firmware);
+  } else if (bss_count > NVF_MAX_BSS) {
+    dummy_wifi_default_bss = ERR_PTR(-EINVAL);
+  } else {
+    dummy_wifi_default_bss = dummy_wifi_bss_table_generate(bss_count);
+  }
+  if (IS_ERR(dummy_wifi_default_bss)) {
+    err = PTR_ERR(dummy_wifi_default_bss);
+    goto l_error_pdev;
+  }
 
-    INIT_WORK(&g_ctx->ws_disconnect, dummy_wifi_disconnect_routine);
-    g_ctx->disconnect_reason_code = 0; // Clear the disconnect reason code.
+  mutex_lock(&dummy_wifi_radios_lock);
+  err = dummy_wifi_set_radio_count(radios);
+  if (err) {
+    /* Free whatever was created before the failure. */
+    list_splice_init(&dummy_wifi_radios, &doomed);
+    dummy_wifi_n_radios = 0;
+    dummy_wifi_free_many(&doomed);
+  } else {
+    dummy_wifi_ready = true;
+  }
+  mutex_unlock(&dummy_wifi_radios_lock);
 
-    INIT_WORK(&g_ctx->ws_scan, dummy_wifi_scan_routine);
-    g_ctx->scan_request = NULL; // Clear the scan request pointer.
+  if (err) {
+    dummy_wifi_bss_table_put(dummy_wifi_default_bss);
+    goto l_error_pdev;
   }
 
-  return g_ctx == NULL; // Return 1 if g_ctx is NULL (initialization failed).
+  return 0;
+
+l_error_pdev:
+  platform_device_unregister(dummy_wifi_pdev);
+  destroy_workqueue(dummy_wifi_wq);
+  return err;
 }
 
 /**
  * @brief Module exit function.
  *
  * This function cleans up and exits the virtual Wi-Fi module.
- * - Cancels any pending workqueue items for connection, disconnection, and
- * scanning.
- * - Frees the memory associated with the context structure.
+ * - Stops accepting changes of the "radios" parameter.
+ * - Frees all radios, cancelling any pending workqueue items for connection,
+ *   disconnection, and scanning.
+ * - Releases the default BSS database, unregisters the parent device and
+ *   destroys the workqueue shared by all radios.
  */
 static void __exit virtual_wifi_exit(void) {
-  /* Make sure that no work is queued for the specified workqueue items. */
-  cancel_work_sync(&g_ctx->ws_connect);
-  cancel_work_sync(&g_ctx->ws_disconnect);
-  cancel_work_sync(&g_ctx->ws_scan);
+  mutex_lock(&dummy_wifi_radios_lock);
+  dummy_wifi_ready = false;
+  dummy_wifi_set_radio_count(0);
+  mutex_unlock(&dummy_wifi_radios_lock);
 
-  /* Free the memory associated with the context structure. */
-  dummy_wifi_free(g_ctx);
+  dummy_wifi_bss_table_put(dummy_wifi_default_bss);
+  platform_device_unregister(dummy_wifi_pdev);
+  destroy_workqueue(dummy_wifi_wq);
 }
 
 module_init(virtual_wifi_init);
@@ -0,0 +1,139 @@
+/**
+ * @file dummywifi_trace.h
+ * @brief Tracepoints of the DummyWiFi control operations.
+ *
+ * Each scan, connect, disconnect and roam is traced when it is requested (or
+ * when the radio rejects it as busy), when its work item starts running and
+ * when it completes, with the time spent queued, executing and reporting to
+ * cfg80211. They show up as dummywifi:* events, e.g.
+ * $ perf trace -e 'dummywifi:*'
+ *
+ * The file is read twice by dummywifi.c, the second time with
+ * CREATE_TRACE_POINTS defined, so the build needs -I$(src) for
+ * <trace/define_trace.h> to find it.
+ */
+
+#ifndef _DUMMYWIFI_TRACE_OPS
+#define _DUMMYWIFI_TRACE_OPS
+
+/**
+ * @enum nvf_op
+ * @brief Control operations of a radio, traced and timed.
+ */
+enum nvf_op {
+  NVF_OP_SCAN,       /**< cfg80211 scan request. */
+  NVF_OP_CONNECT,    /**< cfg80211 connect request. */
+  NVF_OP_DISCONNECT, /**< cfg80211 disconnect request. */
+  NVF_OP_ROAM,       /**< Roam to another access point of the ESS. */
+  NVF_N_OPS,
+};
+
+#endif /* _DUMMYWIFI_TRACE_OPS */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM dummywifi
+
+#if !defined(_DUMMYWIFI_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _DUMMYWIFI_TRACE_H
+
+#include <linux/tracepoint.h> // Tracepoint definitions
+
+TRACE_DEFINE_ENUM(NVF_OP_SCAN);
+TRACE_DEFINE_ENUM(NVF_OP_CONNECT);
+TRACE_DEFINE_ENUM(NVF_OP_DISCONNECT);
+TRACE_DEFINE_ENUM(NVF_OP_ROAM);
+
+#define show_nvf_op(op)                                                        \
+  __print_symbolic(op, {NVF_OP_SCAN, "scan"}, {NVF_OP_CONNECT, "connect"},     \
+                   {NVF_OP_DISCONNECT, "disconnect"}, {NVF_OP_ROAM, "roam"})
+
+/**
+ * @brief An operation of a radio, without timings.
+ */
+DECLARE_EVENT_CLASS(dummywifi_op_class,
+                    TP_PROTO(unsigned int radio, enum nvf_op op),
+                    TP_ARGS(radio, op),
+                    TP_STRUCT__entry(__field(unsigned int, radio)
+                                         __field(int, op)),
+                    TP_fast_assign(__entry->radio = radio;
+                                   __entry->op = op;),
+                    TP_printk("radio=%u op=%s", __entry->radio,
+                              show_nvf_op(__entry->op)));
+
+/**
+ * @brief cfg80211 requested an operation and the radio accepted it.
+ */
+DEFINE_EVENT(dummywifi_op_class, dummywifi_op_request,
+             TP_PROTO(unsigned int radio, enum nvf_op op), TP_ARGS(radio, op));
+
+/**
+ * @brief cfg80211 aborted the operation in progress.
+ */
+DEFINE_EVENT(dummywifi_op_class, dummywifi_op_abort,
+             TP_PROTO(unsigned int radio, enum nvf_op op), TP_ARGS(radio, op));
+
+/**
+ * @brief The radio rejected an operation with -EBUSY.
+ *
+ * @param state State word of the radio, see dummy_wifi_link_state.
+ */
+TRACE_EVENT(dummywifi_op_busy,
+            TP_PROTO(unsigned int radio, enum nvf_op op, int state),
+            TP_ARGS(radio, op, state),
+            TP_STRUCT__entry(__field(unsigned int, radio) __field(int, op)
+                                 __field(int, state)),
+            TP_fast_assign(__entry->radio = radio; __entry->op = op;
+                           __entry->state = state;),
+            TP_printk("radio=%u op=%s state=0x%x", __entry->radio,
+                      show_nvf_op(__entry->op), __entry->state));
+
+/**
+ * @brief The work item of an operation started running.
+ *
+ * @param queue_ns Time the work item waited on the workqueue.
+ */
+TRACE_EVENT(dummywifi_op_start,
+            TP_PROTO(unsigned int radio, enum nvf_op op, u64 queue_ns),
+            TP_ARGS(radio, op, queue_ns),
+            TP_STRUCT__entry(__field(unsigned int, radio) __field(int, op)
+                                 __field(u64, queue_ns)),
+            TP_fast_assign(__entry->radio = radio; __entry->op = op;
+                           __entry->queue_ns = queue_ns;),
+            TP_printk("radio=%u op=%s queue_ns=%llu", __entry->radio,
+                      show_nvf_op(__entry->op), __entry->queue_ns));
+
+/**
+ * @brief An operation completed.
+ *
+ * @param total_ns Time since the request, dwell time of scans included.
+ * @param exec_ns Time spent in the work item, report excluded.
+ * @param report_ns Time spent reporting the outcome to cfg80211.
+ * @param result 0 on success, a negative error code otherwise.
+ */
+TRACE_EVENT(dummywifi_op_done,
+            TP_PROTO(unsigned int radio, enum nvf_op op, u64 total_ns,
+                     u64 exec_ns, u64 report_ns, int result),
+            TP_ARGS(radio, op, total_ns, exec_ns, report_ns, result),
+            TP_STRUCT__entry(__field(unsigned int, radio) __field(int, op)
+                                 __field(u64, total_ns) __field(u64, exec_ns)
+                                     __field(u64, report_ns)
+                                         __field(int, result)),
+            TP_fast_assign(__entry->radio = radio; __entry->op = op;
+                           __entry->total_ns = total_ns;
+                           __entry->exec_ns = exec_ns;
+                           __entry->report_ns = report_ns;
+                           __entry->result = result;),
+            TP_printk("radio=%u op=%s total_ns=%llu exec_ns=%llu "
+                      "report_ns=%llu result=%d",
+                      __entry->radio, show_nvf_op(__entry->op),
+                      __entry->total_ns, __entry->exec_ns, __entry->report_ns,
+                      __entry->result));
+
+#endif /* _DUMMYWIFI_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE dummywifi_trace
+
+#include <trace/define_trace.h>